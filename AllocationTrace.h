@@ -0,0 +1,137 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define FREELIST_TRACE_CALLER() _ReturnAddress()
+#else
+#define FREELIST_TRACE_CALLER() __builtin_return_address(0)
+#endif
+
+// Compile-time tracing hook for STLAdaptor and FreeListAllocator.
+// A sink is a type with a static Record(const TraceEvent&) noexcept, passed as a template argument:
+// NoTrace compiles to nothing, CallbackTrace forwards every event to a function set at run time,
+// RingTrace keeps the last Capacity events of each thread in memory, and TraceRecorder in
+// TraceRecorder.h streams them to a file. Sinks run inside the allocator, under its lock,
+// so they must not allocate from the allocator they trace.
+enum class TraceOp : std::uint8_t
+{
+    Allocate,
+    Free,
+    Destroy         // the allocator is destroyed, size is the bytes still in use
+};
+
+// size is the requested size for Allocate. For Free it is what the hook knows: the requested size in
+// STLAdaptor, the block size in FreeListAllocator
+struct TraceEvent
+{
+    TraceOp op;
+    std::size_t size;
+    std::size_t alignment;
+    const void* address;        // the allocation, or the start of the arena for Destroy
+    const void* allocator;
+    const void* caller;         // return address of the traced function, best effort when it is inlined
+};
+
+
+struct NoTrace
+{
+    static void Record(const TraceEvent&) noexcept {}
+};
+
+
+// Set the callback before the first traced call, it is read without synchronization
+class CallbackTrace
+{
+public:
+    using Callback = void (*)(const TraceEvent& event, void* context);
+
+    static void SetCallback(Callback callback, void* context = nullptr) noexcept;
+    static void Record(const TraceEvent& event) noexcept;
+
+private:
+    inline static Callback s_callback = nullptr;
+    inline static void* s_context = nullptr;
+};
+
+
+// Capacity is a power of two, older events are overwritten
+template<std::size_t Capacity = 1024>
+class RingTrace
+{
+    static_assert(Capacity != 0 && (Capacity & (Capacity - 1u)) == 0, "the capacity must be a power of two");
+
+public:
+    static void Record(const TraceEvent& event) noexcept;
+
+    // Visits the events of the calling thread, oldest first
+    template<typename Visitor>
+    static void ForEach(Visitor&& visitor);
+
+    // Events recorded by the calling thread, including the overwritten ones
+    static std::size_t GetCount() noexcept;
+
+private:
+    struct Ring;
+
+    static Ring& ThreadRing() noexcept;
+};
+
+
+template<std::size_t Capacity>
+struct RingTrace<Capacity>::Ring {
+    TraceEvent events[Capacity];
+    std::size_t count = 0;
+};
+
+
+void CallbackTrace::SetCallback(Callback callback, void* context) noexcept
+{
+    s_callback = callback;
+    s_context = context;
+}
+
+
+void CallbackTrace::Record(const TraceEvent& event) noexcept
+{
+    if (s_callback != nullptr)
+        s_callback(event, s_context);
+}
+
+
+template<std::size_t Capacity>
+void RingTrace<Capacity>::Record(const TraceEvent& event) noexcept
+{
+    Ring& ring = ThreadRing();
+
+    ring.events[ring.count & (Capacity - 1u)] = event;
+    ++ring.count;
+}
+
+
+template<std::size_t Capacity>
+template<typename Visitor>
+void RingTrace<Capacity>::ForEach(Visitor&& visitor)
+{
+    const Ring& ring = ThreadRing();
+    const std::size_t first = ring.count > Capacity ? ring.count - Capacity : 0;
+
+    for (std::size_t i = first; i < ring.count; ++i)
+        visitor(ring.events[i & (Capacity - 1u)]);
+}
+
+
+template<std::size_t Capacity>
+std::size_t RingTrace<Capacity>::GetCount() noexcept
+{
+    return ThreadRing().count;
+}
+
+
+template<std::size_t Capacity>
+typename RingTrace<Capacity>::Ring& RingTrace<Capacity>::ThreadRing() noexcept
+{
+    thread_local Ring ring;
+    return ring;
+}
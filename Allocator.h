@@ -1,101 +1,227 @@
-#pragma once
-
-#include <cstddef>
-#include <cstdint>
-#include <cassert>
-
-// Abstract class
-class Allocator
-{
-public:
-    Allocator(const std::size_t sizeBytes, void* const start) noexcept;
-
-    Allocator(const Allocator&) = delete;
-    Allocator& operator=(Allocator&) = delete;
-
-    Allocator(Allocator&&) noexcept;
-    Allocator& operator=(Allocator&&) noexcept;
-
-    virtual ~Allocator() noexcept;
-
-    // pure virtual methods
-    virtual void* Allocate(const std::size_t& size, const std::uintptr_t& alignment = sizeof(std::intptr_t)) = 0;    // size could be defined like a macros
-    virtual void Free(void* const ptr) = 0;      // Deallocate
-
-    const std::size_t& GetSize() const noexcept;
-    const std::size_t& GetUsed() const noexcept;
-    const std::size_t& GetNumAllocation() const noexcept;
-
-    const void* GetStart() const noexcept;
-
-protected:
-    std::size_t m_size;
-    std::size_t m_usedBytes;
-    std::size_t m_numAllocations;
-
-    void* m_start;
-};
-
-
-Allocator::Allocator(const std::size_t sizeBytes, void* const start) noexcept
-    :
-    m_size(sizeBytes),
-    m_usedBytes(0),
-    m_numAllocations(0),
-    m_start(start)
-{
-    assert(sizeBytes > 0);
-}
-
-Allocator::Allocator(Allocator&& other) noexcept
-    :
-    m_size(other.m_size),
-    m_usedBytes(other.m_usedBytes),
-    m_numAllocations(other.m_numAllocations),
-    m_start(other.m_start)
-{
-    other.m_start = nullptr;
-    other.m_size = 0;
-    other.m_numAllocations = 0;
-    other.m_usedBytes = 0;
-}
-
-Allocator& Allocator::operator=(Allocator&& rhs) noexcept
-{
-    m_size = rhs.m_size;
-    m_usedBytes = rhs.m_usedBytes;
-    m_numAllocations = rhs.m_numAllocations;
-    m_start = rhs.m_start;
-
-    rhs.m_start = nullptr;
-    rhs.m_size = 0;
-    rhs.m_numAllocations = 0;
-    rhs.m_usedBytes = 0;
-
-    return *this;
-}
-
-Allocator::~Allocator() noexcept
-{
-    assert(m_numAllocations == 0 && m_usedBytes == 0);
-}
-
-const std::size_t& Allocator::GetSize() const noexcept
-{
-    return m_size;
-}
-
-const std::size_t& Allocator::GetUsed() const noexcept
-{
-    return m_usedBytes;
-}
-
-const std::size_t& Allocator::GetNumAllocation() const noexcept
-{
-    return m_numAllocations;
-}
-
-const void* Allocator::GetStart() const noexcept
-{
-    return m_start;
-}
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+#include <cstring>
+
+// Abstract class
+class Allocator
+{
+public:
+    Allocator(const std::size_t sizeBytes, void* const start) noexcept;
+
+    Allocator(const Allocator&) = delete;
+    Allocator& operator=(Allocator&) = delete;
+
+    Allocator(Allocator&&) noexcept;
+    Allocator& operator=(Allocator&&) noexcept;
+
+    virtual ~Allocator() noexcept;
+
+    // pure virtual methods
+    virtual void* Allocate(const std::size_t& size, const std::uintptr_t& alignment = sizeof(std::intptr_t)) = 0;    // size could be defined like a macros
+    virtual void Free(void* const ptr) = 0;      // Deallocate
+
+    // Sized deallocation, size is the one ptr was allocated with. Allocators that can use it skip
+    // work, the default checks it and calls Free(ptr). Derived classes keep it visible with a using declaration.
+    virtual void Free(void* const ptr, const std::size_t& size);
+
+    // Bytes usable at ptr, at least the size it was allocated with
+    virtual std::size_t GetAllocationSize(const void* const ptr) const noexcept = 0;
+
+    // Whether ptr was allocated here, the default checks the range GetStart .. GetStart + GetSize
+    virtual bool Owns(const void* const ptr) const noexcept;
+
+    // Resizes the allocation at ptr without moving it, false when it cannot.
+    // The default only succeeds when newSize still fits in GetAllocationSize.
+    virtual bool TryExpandInPlace(void* const ptr, const std::size_t& newSize) noexcept;
+
+    // Resizes in place when possible, otherwise moves the contents to a new allocation and frees ptr.
+    // alignment only applies to a new allocation. nullptr behaves like Allocate; when the move fails
+    // std::bad_alloc is thrown and ptr stays valid.
+    virtual void* Reallocate(void* const ptr, const std::size_t& newSize, const std::uintptr_t& alignment = sizeof(std::intptr_t));
+
+    // count allocations of the same size at once, written to out. Either all of them succeed
+    // or the ones made so far are freed again and the exception is rethrown.
+    virtual void AllocateBatch(const std::size_t& count, const std::size_t& size, const std::uintptr_t& alignment, void** out);
+    virtual void FreeBatch(void* const* ptrs, const std::size_t& count);
+
+    const std::size_t& GetSize() const noexcept;
+    const std::size_t& GetUsed() const noexcept;
+    const std::size_t& GetNumAllocation() const noexcept;
+
+    const void* GetStart() const noexcept;
+
+protected:
+    // Bodies of the defaults above. Self is Allocator for the virtual defaults and the concrete
+    // type in StaticAllocator, where the calls then bind without the vtable.
+    template<typename Self>
+    static void DefaultFree(Self& self, void* const ptr, const std::size_t& size);
+    template<typename Self>
+    static bool DefaultTryExpandInPlace(Self& self, void* const ptr, const std::size_t& newSize) noexcept;
+    template<typename Self>
+    static void* DefaultReallocate(Self& self, void* const ptr, const std::size_t& newSize, const std::uintptr_t& alignment);
+    template<typename Self>
+    static void DefaultAllocateBatch(Self& self, const std::size_t& count, const std::size_t& size, const std::uintptr_t& alignment,
+        void** out);
+    template<typename Self>
+    static void DefaultFreeBatch(Self& self, void* const* ptrs, const std::size_t& count);
+
+    std::size_t m_size;
+    std::size_t m_usedBytes;
+    std::size_t m_numAllocations;
+
+    void* m_start;
+};
+
+
+Allocator::Allocator(const std::size_t sizeBytes, void* const start) noexcept
+    :
+    m_size(sizeBytes),
+    m_usedBytes(0),
+    m_numAllocations(0),
+    m_start(start)
+{
+    assert(sizeBytes > 0);
+}
+
+Allocator::Allocator(Allocator&& other) noexcept
+    :
+    m_size(other.m_size),
+    m_usedBytes(other.m_usedBytes),
+    m_numAllocations(other.m_numAllocations),
+    m_start(other.m_start)
+{
+    other.m_start = nullptr;
+    other.m_size = 0;
+    other.m_numAllocations = 0;
+    other.m_usedBytes = 0;
+}
+
+Allocator& Allocator::operator=(Allocator&& rhs) noexcept
+{
+    m_size = rhs.m_size;
+    m_usedBytes = rhs.m_usedBytes;
+    m_numAllocations = rhs.m_numAllocations;
+    m_start = rhs.m_start;
+
+    rhs.m_start = nullptr;
+    rhs.m_size = 0;
+    rhs.m_numAllocations = 0;
+    rhs.m_usedBytes = 0;
+
+    return *this;
+}
+
+Allocator::~Allocator() noexcept
+{
+    assert(m_numAllocations == 0 && m_usedBytes == 0);
+}
+
+void Allocator::Free(void* const ptr, const std::size_t& size)
+{
+    DefaultFree(*this, ptr, size);
+}
+
+bool Allocator::Owns(const void* const ptr) const noexcept
+{
+    return reinterpret_cast<std::uintptr_t>(ptr) - reinterpret_cast<std::uintptr_t>(m_start) < m_size;
+}
+
+bool Allocator::TryExpandInPlace(void* const ptr, const std::size_t& newSize) noexcept
+{
+    return DefaultTryExpandInPlace(*this, ptr, newSize);
+}
+
+void* Allocator::Reallocate(void* const ptr, const std::size_t& newSize, const std::uintptr_t& alignment)
+{
+    return DefaultReallocate(*this, ptr, newSize, alignment);
+}
+
+void Allocator::AllocateBatch(const std::size_t& count, const std::size_t& size, const std::uintptr_t& alignment, void** out)
+{
+    DefaultAllocateBatch(*this, count, size, alignment, out);
+}
+
+void Allocator::FreeBatch(void* const* ptrs, const std::size_t& count)
+{
+    DefaultFreeBatch(*this, ptrs, count);
+}
+
+template<typename Self>
+void Allocator::DefaultFree(Self& self, void* const ptr, [[maybe_unused]] const std::size_t& size)
+{
+    assert(ptr != nullptr && size <= self.GetAllocationSize(ptr));
+    self.Free(ptr);
+}
+
+template<typename Self>
+bool Allocator::DefaultTryExpandInPlace(Self& self, void* const ptr, const std::size_t& newSize) noexcept
+{
+    assert(ptr != nullptr);
+    return newSize <= self.GetAllocationSize(ptr);
+}
+
+template<typename Self>
+void* Allocator::DefaultReallocate(Self& self, void* const ptr, const std::size_t& newSize, const std::uintptr_t& alignment)
+{
+    if (ptr == nullptr)
+        return self.Allocate(newSize, alignment);
+
+    if (self.TryExpandInPlace(ptr, newSize))
+        return ptr;
+
+    const std::size_t oldSize = self.GetAllocationSize(ptr);
+    void* newPtr = self.Allocate(newSize, alignment);
+
+    std::memcpy(newPtr, ptr, oldSize < newSize ? oldSize : newSize);
+    self.Free(ptr);
+
+    return newPtr;
+}
+
+template<typename Self>
+void Allocator::DefaultAllocateBatch(Self& self, const std::size_t& count, const std::size_t& size, const std::uintptr_t& alignment,
+    void** out)
+{
+    std::size_t allocated = 0;
+
+    try
+    {
+        for (; allocated < count; ++allocated)
+            out[allocated] = self.Allocate(size, alignment);
+    }
+    catch (...)
+    {
+        self.FreeBatch(out, allocated);
+        throw;
+    }
+}
+
+template<typename Self>
+void Allocator::DefaultFreeBatch(Self& self, void* const* ptrs, const std::size_t& count)
+{
+    for (std::size_t i = 0; i < count; ++i)
+        self.Free(ptrs[i]);
+}
+
+const std::size_t& Allocator::GetSize() const noexcept
+{
+    return m_size;
+}
+
+const std::size_t& Allocator::GetUsed() const noexcept
+{
+    return m_usedBytes;
+}
+
+const std::size_t& Allocator::GetNumAllocation() const noexcept
+{
+    return m_numAllocations;
+}
+
+const void* Allocator::GetStart() const noexcept
+{
+    return m_start;
+}
@@ -0,0 +1,57 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+
+// Standard allocators behind the Allocate/Free calls of this repository, the baselines of
+// TraceReplay and AllocatorBenchmark. Free takes the size and the alignment of the request,
+// the standard deallocation functions need both.
+
+// The global operator new: malloc, or whatever malloc replacement (jemalloc, mimalloc) the program links
+class NewDeleteBaseline
+{
+public:
+    void* Allocate(const std::size_t& size, const std::uintptr_t& alignment);
+    void Free(void* const ptr, const std::size_t& size, const std::uintptr_t& alignment) noexcept;
+};
+
+
+// A standard pool resource: size classes of chunks, as in jemalloc-style allocators.
+// std::pmr::unsynchronized_pool_resource for one thread, std::pmr::synchronized_pool_resource for many
+template<typename Resource>
+class PoolResourceBaseline
+{
+public:
+    void* Allocate(const std::size_t& size, const std::uintptr_t& alignment);
+    void Free(void* const ptr, const std::size_t& size, const std::uintptr_t& alignment) noexcept;
+
+private:
+    Resource m_pool;
+};
+
+
+void* NewDeleteBaseline::Allocate(const std::size_t& size, const std::uintptr_t& alignment)
+{
+    return ::operator new(size, std::align_val_t(alignment));
+}
+
+
+void NewDeleteBaseline::Free(void* const ptr, const std::size_t& size, const std::uintptr_t& alignment) noexcept
+{
+    ::operator delete(ptr, size, std::align_val_t(alignment));
+}
+
+
+template<typename Resource>
+void* PoolResourceBaseline<Resource>::Allocate(const std::size_t& size, const std::uintptr_t& alignment)
+{
+    return m_pool.allocate(size, alignment);
+}
+
+
+template<typename Resource>
+void PoolResourceBaseline<Resource>::Free(void* const ptr, const std::size_t& size, const std::uintptr_t& alignment) noexcept
+{
+    m_pool.deallocate(ptr, size, alignment);
+}
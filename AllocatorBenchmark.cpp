@@ -0,0 +1,553 @@
+﻿#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <random>
+#include <regex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "AllocatorBaselines.h"
+#include "FreeListAllocatorCustom.h"
+#include "ConcurrentFreeListAllocator.h"
+
+// Allocate/Free microbenchmarks in the style of Google Benchmark, without the dependency.
+//
+//     AllocatorBenchmark [--benchmark_filter=<regex>] [--benchmark_min_time=<seconds>] [--benchmark_list_tests]
+//
+// A round allocates a batch of blocks and frees them in the chosen order. Every benchmark varies one
+// parameter of the workload and keeps the others at their defaults:
+// BM_Size the size distribution, BM_Alignment the alignment, BM_FreeOrder the order of the frees,
+// BM_FreeListLength the number of holes in the free list before the run, BM_Threads the threads sharing one allocator.
+//
+// A benchmark runs rounds until the minimum time has passed for the throughput, then a fixed number of
+// rounds with a clock around every call for the latency. The latencies include the cost of reading the clock.
+
+enum class SizeDistribution
+{
+    Fixed,          // kFixedSize bytes
+    Uniform,        // kMinSize .. kMaxUniformSize
+    LogNormal       // median kFixedSize, clamped to kMinSize .. kMaxLogNormalSize
+};
+
+enum class FreeOrder
+{
+    Lifo,
+    Fifo,
+    Random
+};
+
+struct Workload
+{
+    SizeDistribution sizes = SizeDistribution::Uniform;
+    std::size_t alignment = sizeof(std::intptr_t);
+    FreeOrder order = FreeOrder::Lifo;
+    std::size_t batch = 256;
+    std::size_t holes = 0;              // free blocks the allocator has to pass over
+    unsigned threads = 1;
+};
+
+struct BenchmarkResult
+{
+    bool outOfMemory = false;
+    std::size_t rounds = 0;
+    double nsPerOp = 0.0;
+    double opsPerSecond = 0.0;
+    std::uint64_t p50 = 0;
+    std::uint64_t p99 = 0;
+};
+
+struct Benchmark
+{
+    std::string name;
+    std::function<BenchmarkResult(const double minTime)> run;
+};
+
+// What one thread measured
+struct ThreadResult
+{
+    bool outOfMemory = false;
+    std::size_t rounds = 0;
+    double seconds = 0.0;
+    std::vector<std::uint64_t> latencies;
+};
+
+using Clock = std::chrono::steady_clock;
+
+using LockedFreeListAllocator = BasicFreeListAllocator<FreeListPolicies<RuntimePolicy<FreeListFitPolicy::SegregatedFit>,
+    RuntimePolicy<FreeListHeaderPolicy::Standard>, RuntimePolicy<FreeListZeroPolicy::None>, std::mutex>>;
+
+static constexpr std::size_t kArenaSize = 64 * 1024 * 1024;
+static constexpr std::size_t kFixedSize = 64;
+static constexpr std::size_t kMinSize = 8;
+static constexpr std::size_t kMaxUniformSize = 512;
+static constexpr std::size_t kMaxLogNormalSize = 8192;
+static constexpr std::size_t kHoleSize = 32;                // smaller than any fixed-size block, so no hole fits
+static constexpr std::size_t kSlices = 8;                   // rounds cycle through this many batches of sizes
+static constexpr std::size_t kLatencyOps = 64 * 1024;       // timed calls per thread
+
+static const char* const kUsage =
+    "usage: AllocatorBenchmark [--benchmark_filter=<regex>] [--benchmark_min_time=<seconds>] [--benchmark_list_tests]\n";
+
+
+static const char* SizeName(const SizeDistribution sizes) noexcept
+{
+    switch (sizes)
+    {
+    case SizeDistribution::Fixed: return "fixed";
+    case SizeDistribution::Uniform: return "uniform";
+    default: return "lognormal";
+    }
+}
+
+
+static const char* OrderName(const FreeOrder order) noexcept
+{
+    switch (order)
+    {
+    case FreeOrder::Lifo: return "lifo";
+    case FreeOrder::Fifo: return "fifo";
+    default: return "random";
+    }
+}
+
+
+// The allocators of this repository take the size of the request, the baselines the alignment as well
+template<typename Engine>
+static void FreeBlock(Engine& engine, void* const ptr, const std::size_t& size, const std::uintptr_t& alignment) noexcept
+{
+    if constexpr (std::is_base_of_v<Allocator, Engine>)
+        engine.Free(ptr, size);
+    else
+        engine.Free(ptr, size, alignment);
+}
+
+
+static std::vector<std::size_t> MakeSizes(const Workload& workload, std::mt19937& rng)
+{
+    std::vector<std::size_t> sizes(workload.batch * kSlices);
+
+    std::uniform_int_distribution<std::size_t> uniform(kMinSize, kMaxUniformSize);
+    std::lognormal_distribution<double> logNormal(std::log(static_cast<double>(kFixedSize)), 1.0);
+
+    for (std::size_t& size : sizes)
+    {
+        if (workload.sizes == SizeDistribution::Fixed)
+            size = kFixedSize;
+        else if (workload.sizes == SizeDistribution::Uniform)
+            size = uniform(rng);
+        else
+            size = std::clamp(static_cast<std::size_t>(logNormal(rng)), kMinSize, kMaxLogNormalSize);
+    }
+
+    return sizes;
+}
+
+
+// Indices into a batch in the order they are freed, one permutation per slice
+static std::vector<std::uint32_t> MakeFreeOrder(const Workload& workload, std::mt19937& rng)
+{
+    std::vector<std::uint32_t> order(workload.batch * kSlices);
+
+    for (std::size_t slice = 0; slice < kSlices; ++slice)
+    {
+        const auto first = order.begin() + slice * workload.batch;
+        const auto last = first + workload.batch;
+
+        for (std::size_t i = 0; i < workload.batch; ++i)
+            first[i] = static_cast<std::uint32_t>(workload.order == FreeOrder::Lifo ? workload.batch - 1u - i : i);
+
+        if (workload.order == FreeOrder::Random)
+            std::shuffle(first, last, rng);
+    }
+
+    return order;
+}
+
+
+template<typename Engine>
+static void RunThread(Engine& engine, const Workload& workload, const unsigned seed, const Clock::time_point& deadline,
+    ThreadResult& result)
+{
+    std::mt19937 rng(seed);
+
+    const std::vector<std::size_t> sizes = MakeSizes(workload, rng);
+    const std::vector<std::uint32_t> order = MakeFreeOrder(workload, rng);
+    const std::uintptr_t alignment = workload.alignment;
+
+    std::vector<void*> blocks(workload.batch);
+    std::size_t slice = 0;
+    std::size_t allocated = 0;
+
+    // With latencies set every call is timed into it
+    const auto round = [&](const std::size_t roundSlice, std::vector<std::uint64_t>* latencies) {
+        slice = roundSlice;
+
+        const std::size_t* sliceSizes = sizes.data() + slice * workload.batch;
+        const std::uint32_t* sliceOrder = order.data() + slice * workload.batch;
+
+        for (allocated = 0; allocated < workload.batch; ++allocated)
+        {
+            const Clock::time_point before = latencies != nullptr ? Clock::now() : Clock::time_point();
+            blocks[allocated] = engine.Allocate(sliceSizes[allocated], alignment);
+
+            if (latencies != nullptr)
+                latencies->push_back(static_cast<std::uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - before).count()));
+        }
+
+        for (std::size_t i = 0; i < workload.batch; ++i)
+        {
+            const std::uint32_t k = sliceOrder[i];
+
+            const Clock::time_point before = latencies != nullptr ? Clock::now() : Clock::time_point();
+            FreeBlock(engine, blocks[k], sliceSizes[k], alignment);
+
+            if (latencies != nullptr)
+                latencies->push_back(static_cast<std::uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - before).count()));
+        }
+
+        allocated = 0;
+    };
+
+    try
+    {
+        const Clock::time_point start = Clock::now();
+
+        do
+        {
+            round(result.rounds % kSlices, nullptr);
+            ++result.rounds;
+        } while (Clock::now() < deadline);
+
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        const std::size_t latencyRounds = std::max<std::size_t>(1u, kLatencyOps / (2u * workload.batch));
+        result.latencies.reserve(latencyRounds * 2u * workload.batch);
+
+        for (std::size_t r = 0; r < latencyRounds; ++r)
+            round(r % kSlices, &result.latencies);
+    }
+    catch (const std::bad_alloc&)
+    {
+        result.outOfMemory = true;
+
+        // The frees of a round never throw, so only the blocks of an unfinished allocation loop are left
+        const std::size_t* sliceSizes = sizes.data() + slice * workload.batch;
+        for (std::size_t i = 0; i < allocated; ++i)
+            FreeBlock(engine, blocks[i], sliceSizes[i], alignment);
+    }
+
+    if constexpr (std::is_same_v<Engine, ConcurrentFreeListAllocator>)
+        engine.ReleaseThreadCache();
+}
+
+
+// Leaves holes free blocks between live ones, returns the live ones for ReleaseHoles.
+// When the arena runs out the blocks made so far are freed again before bad_alloc propagates
+template<typename Engine>
+static std::vector<void*> MakeHoles(Engine& engine, const std::size_t& holes)
+{
+    std::vector<void*> blocks(2u * holes);
+    std::size_t allocated = 0;
+
+    try
+    {
+        for (; allocated < blocks.size(); ++allocated)
+            blocks[allocated] = engine.Allocate(kHoleSize, sizeof(std::intptr_t));
+    }
+    catch (const std::bad_alloc&)
+    {
+        for (std::size_t i = 0; i < allocated; ++i)
+            FreeBlock(engine, blocks[i], kHoleSize, sizeof(std::intptr_t));
+        throw;
+    }
+
+    std::vector<void*> live;
+    live.reserve(holes);
+
+    for (std::size_t i = 0; i < blocks.size(); ++i)
+    {
+        if (i % 2 == 0)
+            FreeBlock(engine, blocks[i], kHoleSize, sizeof(std::intptr_t));
+        else
+            live.push_back(blocks[i]);
+    }
+
+    return live;
+}
+
+
+template<typename Engine>
+static void ReleaseHoles(Engine& engine, const std::vector<void*>& live) noexcept
+{
+    for (void* const block : live)
+        FreeBlock(engine, block, kHoleSize, sizeof(std::intptr_t));
+}
+
+
+template<typename Engine>
+static BenchmarkResult RunWorkload(Engine& engine, const Workload& workload, const double minTime)
+{
+    const std::vector<void*> holes = MakeHoles(engine, workload.holes);
+
+    std::vector<ThreadResult> threadResults(workload.threads);
+    std::vector<std::thread> threads;
+
+    // The threads start together and stop at the same deadline
+    std::atomic<bool> go{ false };
+    Clock::time_point deadline;
+
+    for (unsigned t = 0; t < workload.threads; ++t)
+    {
+        threads.emplace_back([&, t]() {
+            while (!go.load(std::memory_order_acquire))
+                std::this_thread::yield();
+
+            RunThread(engine, workload, 1234u + t, deadline, threadResults[t]);
+        });
+    }
+
+    deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(minTime));
+    go.store(true, std::memory_order_release);
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    ReleaseHoles(engine, holes);
+
+    BenchmarkResult result;
+    std::vector<std::uint64_t> latencies;
+    double seconds = 0.0;
+
+    for (const ThreadResult& threadResult : threadResults)
+    {
+        result.outOfMemory |= threadResult.outOfMemory;
+        result.rounds += threadResult.rounds;
+        seconds = std::max(seconds, threadResult.seconds);
+        latencies.insert(latencies.end(), threadResult.latencies.begin(), threadResult.latencies.end());
+    }
+
+    if (result.outOfMemory || seconds <= 0.0)
+        return result;
+
+    const double ops = 2.0 * static_cast<double>(result.rounds) * workload.batch;
+    result.opsPerSecond = ops / seconds;
+    result.nsPerOp = 1e9 * seconds * workload.threads / ops;
+
+    std::sort(latencies.begin(), latencies.end());
+    result.p50 = latencies[latencies.size() / 2u];
+    result.p99 = latencies[std::min(latencies.size() - 1u, latencies.size() * 99u / 100u)];
+
+    return result;
+}
+
+
+// Every run starts on a fresh allocator over the same arena
+template<typename Alloc, typename... Args>
+static BenchmarkResult RunOnArena(const Workload& workload, const double minTime, Args... args)
+{
+    static void* const arena = ::operator new(kArenaSize, std::align_val_t(64));
+
+    alignas(Alloc) unsigned char storage[sizeof(Alloc)];
+    Alloc& allocator = *new (storage) Alloc(kArenaSize, arena, args...);
+
+    BenchmarkResult result;
+    try
+    {
+        result = RunWorkload(allocator, workload, minTime);
+    }
+    catch (const std::bad_alloc&)
+    {
+        result.outOfMemory = true;      // by MakeHoles
+    }
+
+    allocator.~Alloc();
+    return result;
+}
+
+
+template<FreeListFitPolicy Fit>
+static BenchmarkResult RunFreeList(const Workload& workload, const double minTime)
+{
+    return RunOnArena<FreeListAllocator>(workload, minTime, Fit, FreeListZeroPolicy::None);
+}
+
+
+static BenchmarkResult RunLockedFreeList(const Workload& workload, const double minTime)
+{
+    return RunOnArena<LockedFreeListAllocator>(workload, minTime);
+}
+
+
+static BenchmarkResult RunConcurrentFreeList(const Workload& workload, const double minTime)
+{
+    return RunOnArena<ConcurrentFreeListAllocator>(workload, minTime);
+}
+
+
+template<typename Baseline>
+static BenchmarkResult RunBaseline(const Workload& workload, const double minTime)
+{
+    Baseline baseline;
+    return RunWorkload(baseline, workload, minTime);
+}
+
+
+struct BenchmarkEngine
+{
+    const char* name;
+    BenchmarkResult (*run)(const Workload& workload, const double minTime);
+};
+
+static const BenchmarkEngine kSingleThreadEngines[] = {
+    { "freelist-best", &RunFreeList<FreeListFitPolicy::BestFit> },
+    { "freelist-segregated", &RunFreeList<FreeListFitPolicy::SegregatedFit> },
+    { "freelist-indexed", &RunFreeList<FreeListFitPolicy::IndexedBestFit> },
+    { "new-delete", &RunBaseline<NewDeleteBaseline> },
+    { "pmr-pool", &RunBaseline<PoolResourceBaseline<std::pmr::unsynchronized_pool_resource>> }
+};
+
+static const BenchmarkEngine kMultiThreadEngines[] = {
+    { "freelist-mutex", &RunLockedFreeList },
+    { "freelist-concurrent", &RunConcurrentFreeList },
+    { "new-delete", &RunBaseline<NewDeleteBaseline> },
+    { "pmr-sync-pool", &RunBaseline<PoolResourceBaseline<std::pmr::synchronized_pool_resource>> }
+};
+
+
+template<std::size_t N>
+static void Register(std::vector<Benchmark>& benchmarks, const std::string& family, const BenchmarkEngine (&engines)[N],
+    const std::string& argument, const Workload& workload)
+{
+    for (const BenchmarkEngine& engine : engines)
+    {
+        const auto run = engine.run;
+        benchmarks.push_back({ family + "/" + engine.name + "/" + argument,
+            [run, workload](const double minTime) { return run(workload, minTime); } });
+    }
+}
+
+
+static std::vector<Benchmark> RegisterBenchmarks()
+{
+    std::vector<Benchmark> benchmarks;
+
+    for (const SizeDistribution sizes : { SizeDistribution::Fixed, SizeDistribution::Uniform, SizeDistribution::LogNormal })
+    {
+        Workload workload;
+        workload.sizes = sizes;
+        Register(benchmarks, "BM_Size", kSingleThreadEngines, SizeName(sizes), workload);
+    }
+
+    for (const std::size_t alignment : { 8, 16, 64, 256 })
+    {
+        Workload workload;
+        workload.alignment = alignment;
+        Register(benchmarks, "BM_Alignment", kSingleThreadEngines, std::to_string(alignment), workload);
+    }
+
+    for (const FreeOrder order : { FreeOrder::Lifo, FreeOrder::Fifo, FreeOrder::Random })
+    {
+        Workload workload;
+        workload.order = order;
+        Register(benchmarks, "BM_FreeOrder", kSingleThreadEngines, OrderName(order), workload);
+    }
+
+    // Fixed sizes that no hole can serve, so a search that walks the list pays for every hole
+    for (const std::size_t holes : { 0, 64, 1024, 8192 })
+    {
+        Workload workload;
+        workload.sizes = SizeDistribution::Fixed;
+        workload.batch = 64;
+        workload.holes = holes;
+        Register(benchmarks, "BM_FreeListLength", kSingleThreadEngines, std::to_string(holes), workload);
+    }
+
+    for (const unsigned threads : { 1, 2, 4, 8 })
+    {
+        Workload workload;
+        workload.order = FreeOrder::Random;
+        workload.threads = threads;
+        Register(benchmarks, "BM_Threads", kMultiThreadEngines, std::to_string(threads), workload);
+    }
+
+    return benchmarks;
+}
+
+
+static void PrintResult(const Benchmark& benchmark, const BenchmarkResult& result)
+{
+    if (result.outOfMemory)
+    {
+        std::printf("%-48s ERROR OCCURRED: 'out of memory'\n", benchmark.name.c_str());
+        return;
+    }
+
+    std::printf("%-48s %9.1f ns %7llu ns %7llu ns %10zu %9.3fM/s\n", benchmark.name.c_str(), result.nsPerOp,
+        static_cast<unsigned long long>(result.p50), static_cast<unsigned long long>(result.p99),
+        result.rounds, result.opsPerSecond / 1e6);
+}
+
+
+int main(int argc, char** argv)
+{
+    std::string filter = ".";
+    double minTime = 0.1;
+    bool listOnly = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strncmp(argv[i], "--benchmark_filter=", 19) == 0)
+            filter = argv[i] + 19;
+        else if (std::strncmp(argv[i], "--benchmark_min_time=", 21) == 0)
+            minTime = std::strtod(argv[i] + 21, nullptr);
+        else if (std::strcmp(argv[i], "--benchmark_list_tests") == 0)
+            listOnly = true;
+        else
+        {
+            std::fputs(kUsage, stderr);
+            return 1;
+        }
+    }
+
+    std::regex pattern;
+    try
+    {
+        pattern = std::regex(filter);
+    }
+    catch (const std::regex_error&)
+    {
+        std::fprintf(stderr, "invalid filter %s\n", filter.c_str());
+        return 1;
+    }
+
+    const std::vector<Benchmark> benchmarks = RegisterBenchmarks();
+
+    if (!listOnly)
+    {
+        std::printf("%-48s %12s %10s %10s %10s %12s\n", "Benchmark", "Time/op", "p50", "p99", "Iterations", "items/s");
+        std::printf("%s\n", std::string(107, '-').c_str());
+    }
+
+    for (const Benchmark& benchmark : benchmarks)
+    {
+        if (!std::regex_search(benchmark.name, pattern))
+            continue;
+
+        if (listOnly)
+            std::printf("%s\n", benchmark.name.c_str());
+        else
+            PrintResult(benchmark, benchmark.run(minTime));
+    }
+
+    return 0;
+}
@@ -0,0 +1,78 @@
+﻿#pragma once
+#include <memory_resource>
+#include <type_traits>
+#include "FixedAllocator.h"
+
+// std::pmr::memory_resource over an allocator, which must outlive the resource.
+// pmr containers keep their type whatever the arena behind them, unlike STLAdaptor<T, Alloc>.
+// Alloc is the static type as in STLAdaptor, Alloc = Allocator takes any allocator through the vtable.
+// do_deallocate passes the size on to the sized Free.
+template<typename Alloc = Allocator>
+class AllocatorResource final : public std::pmr::memory_resource
+{
+public:
+    explicit AllocatorResource(Alloc& allocator) noexcept;
+
+    AllocatorResource(const AllocatorResource&) = delete;
+    AllocatorResource& operator=(const AllocatorResource&) = delete;
+
+    Alloc& GetAllocator() const noexcept;
+
+private:
+    virtual void* do_allocate(std::size_t bytes, std::size_t alignment) override final;
+    virtual void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) override final;
+
+    // Equal when both hand out memory from the same allocator, fixed arenas compare by GetStart as in STLAdaptor
+    virtual bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override final;
+
+protected:
+    Alloc& m_allocator;
+};
+
+
+template<typename Alloc>
+AllocatorResource<Alloc>::AllocatorResource(Alloc& allocator) noexcept
+    :
+    m_allocator(allocator)
+{}
+
+
+template<typename Alloc>
+Alloc& AllocatorResource<Alloc>::GetAllocator() const noexcept
+{
+    return m_allocator;
+}
+
+
+template<typename Alloc>
+void* AllocatorResource<Alloc>::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+    return m_allocator.Allocate(bytes, alignment);
+}
+
+
+template<typename Alloc>
+void AllocatorResource<Alloc>::do_deallocate(void* ptr, std::size_t bytes, [[maybe_unused]] std::size_t alignment)
+{
+    m_allocator.Free(ptr, bytes);
+}
+
+
+template<typename Alloc>
+bool AllocatorResource<Alloc>::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+    if (this == &other)
+        return true;
+
+    const auto* resource = dynamic_cast<const AllocatorResource<Alloc>*>(&other);
+    if (resource == nullptr)
+        return false;
+
+    if (&m_allocator == &resource->m_allocator)
+        return true;
+
+    if constexpr (std::is_base_of_v<FixedAllocator, Alloc>)
+        return m_allocator.GetStart() == resource->m_allocator.GetStart();
+    else
+        return false;
+}
@@ -0,0 +1,49 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Portable bit scans used by the size-class bitmaps.
+// Both functions require a non-zero mask.
+
+inline unsigned FindLowestSetBit(std::uint64_t mask) noexcept
+{
+    assert(mask != 0);
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return static_cast<unsigned>(index);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if (_BitScanForward(&index, static_cast<unsigned long>(mask)))
+        return static_cast<unsigned>(index);
+    _BitScanForward(&index, static_cast<unsigned long>(mask >> 32));
+    return static_cast<unsigned>(index) + 32u;
+#else
+    return static_cast<unsigned>(__builtin_ctzll(mask));
+#endif
+}
+
+
+inline unsigned FindHighestSetBit(std::uint64_t mask) noexcept
+{
+    assert(mask != 0);
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanReverse64(&index, mask);
+    return static_cast<unsigned>(index);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if (_BitScanReverse(&index, static_cast<unsigned long>(mask >> 32)))
+        return static_cast<unsigned>(index) + 32u;
+    _BitScanReverse(&index, static_cast<unsigned long>(mask));
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(63 - __builtin_clzll(mask));
+#endif
+}
@@ -0,0 +1,211 @@
+﻿#pragma once
+#include <new>
+#include <type_traits>
+#include "StaticAllocator.h"
+
+// A row of Child allocators over one caller-provided region, one per size bucket.
+// Bucket i serves requests up to Min + (i + 1) * Step bytes, requests up to Min go to bucket 0,
+// requests above Max throw std::bad_alloc; put a Segregator in front for those.
+// The region is split into equal slices, one per bucket, so Free finds the bucket from the
+// address alone. A Child constructible from (size, start, blockSize), such as PoolAllocator,
+// gets the upper bound of its bucket as the block size.
+template<typename Child, std::size_t Min, std::size_t Max, std::size_t Step>
+class Bucketizer final : public StaticAllocator<Bucketizer<Child, Min, Max, Step>>
+{
+    using Base = StaticAllocator<Bucketizer<Child, Min, Max, Step>>;
+
+    static_assert(Step > 0 && Max > Min && (Max - Min) % Step == 0, "the buckets must cover Min .. Max in whole steps");
+
+public:
+    static constexpr std::size_t kNumBuckets = (Max - Min) / Step;
+
+    Bucketizer(const std::size_t sizeBytes, void* start) noexcept;
+
+    Bucketizer(const Bucketizer&) = delete;
+    Bucketizer& operator=(const Bucketizer&) = delete;
+
+    // The buckets live inside the Bucketizer
+    Bucketizer(Bucketizer&&) = delete;
+    Bucketizer& operator=(Bucketizer&&) = delete;
+
+    ~Bucketizer() noexcept override final;
+
+    virtual void* Allocate(const std::size_t& size, const std::uintptr_t& alignment = sizeof(std::intptr_t)) override final;
+    virtual void Free(void* const ptr) noexcept override final;
+    virtual void Free(void* const ptr, const std::size_t& size) noexcept override final;
+
+    virtual std::size_t GetAllocationSize(const void* const ptr) const noexcept override final;
+
+    // Only within the bucket that holds ptr
+    virtual bool TryExpandInPlace(void* const ptr, const std::size_t& newSize) noexcept override final;
+
+    // The whole batch goes to one bucket, so its own batch path is used
+    virtual void AllocateBatch(const std::size_t& count, const std::size_t& size, const std::uintptr_t& alignment,
+        void** out) override final;
+
+    Child& GetBucket(const std::size_t& index) noexcept;
+    static constexpr std::size_t BucketFor(const std::size_t& size) noexcept;
+
+private:
+    static constexpr std::size_t kSliceAlignment = alignof(std::max_align_t);
+
+    std::size_t BucketOf(const void* const ptr) const noexcept;
+    const Child& GetBucket(const std::size_t& index) const noexcept;
+
+protected:
+    using Base::m_usedBytes;
+    using Base::m_numAllocations;
+    using Base::m_start;
+
+    std::size_t m_sliceSize;
+    alignas(Child) unsigned char m_buckets[kNumBuckets][sizeof(Child)];
+};
+
+
+template<typename Child, std::size_t Min, std::size_t Max, std::size_t Step>
+Bucketizer<Child, Min, Max, Step>::Bucketizer(const std::size_t sizeBytes, void* start) noexcept
+    :
+    Base(sizeBytes, start), m_sliceSize((sizeBytes / kNumBuckets) & ~(kSliceAlignment - 1u))
+{
+    assert(reinterpret_cast<std::uintptr_t>(start) % kSliceAlignment == 0);
+    assert(m_sliceSize > 0);
+
+    for (std::size_t i = 0; i < kNumBuckets; ++i)
+    {
+        void* slice = reinterpret_cast<std::uint8_t*>(start) + i * m_sliceSize;
+
+        if constexpr (std::is_constructible_v<Child, std::size_t, void*, std::size_t>)
+            new (m_buckets[i]) Child(m_sliceSize, slice, Min + (i + 1u) * Step);
+        else
+            new (m_buckets[i]) Child(m_sliceSize, slice);
+    }
+}
+
+
+template<typename Child, std::size_t Min, std::size_t Max, std::size_t Step>
+Bucketizer<Child, Min, Max, Step>::~Bucketizer() noexcept
+{
+    for (std::size_t i = 0; i < kNumBuckets; ++i)
+        GetBucket(i).~Child();
+}
+
+
+template<typename Child, std::size_t Min, std::size_t Max, std::size_t Step>
+void* Bucketizer<Child, Min, Max, Step>::Allocate(const std::size_t& size, const std::uintptr_t& alignment)
+{
+    if (size > Max)
+        throw std::bad_alloc();
+
+    Child& bucket = GetBucket(BucketFor(size));
+
+    const std::size_t usedBefore = bucket.GetUsed();
+    void* ptr = bucket.Allocate(size, alignment);
+
+    m_usedBytes += bucket.GetUsed() - usedBefore;
+    ++m_numAllocations;
+
+    return ptr;
+}
+
+
+template<typename Child, std::size_t Min, std::size_t Max, std::size_t Step>
+void Bucketizer<Child, Min, Max, Step>::Free(void* const ptr) noexcept
+{
+    assert(ptr != nullptr && m_numAllocations > 0);
+
+    Child& bucket = GetBucket(BucketOf(ptr));
+
+    const std::size_t usedBefore = bucket.GetUsed();
+    bucket.Free(ptr);
+
+    m_usedBytes -= usedBefore - bucket.GetUsed();
+    --m_numAllocations;
+}
+
+
+template<typename Child, std::size_t Min, std::size_t Max, std::size_t Step>
+void Bucketizer<Child, Min, Max, Step>::Free(void* const ptr, const std::size_t& size) noexcept
+{
+    assert(ptr != nullptr && m_numAllocations > 0);
+
+    Child& bucket = GetBucket(BucketOf(ptr));
+
+    const std::size_t usedBefore = bucket.GetUsed();
+    bucket.Free(ptr, size);
+
+    m_usedBytes -= usedBefore - bucket.GetUsed();
+    --m_numAllocations;
+}
+
+
+template<typename Child, std::size_t Min, std::size_t Max, std::size_t Step>
+std::size_t Bucketizer<Child, Min, Max, Step>::GetAllocationSize(const void* const ptr) const noexcept
+{
+    return GetBucket(BucketOf(ptr)).GetAllocationSize(ptr);
+}
+
+
+template<typename Child, std::size_t Min, std::size_t Max, std::size_t Step>
+bool Bucketizer<Child, Min, Max, Step>::TryExpandInPlace(void* const ptr, const std::size_t& newSize) noexcept
+{
+    assert(ptr != nullptr);
+
+    Child& bucket = GetBucket(BucketOf(ptr));
+
+    const std::size_t usedBefore = bucket.GetUsed();
+    if (!bucket.TryExpandInPlace(ptr, newSize))
+        return false;
+
+    m_usedBytes = m_usedBytes - usedBefore + bucket.GetUsed();
+    return true;
+}
+
+
+template<typename Child, std::size_t Min, std::size_t Max, std::size_t Step>
+void Bucketizer<Child, Min, Max, Step>::AllocateBatch(const std::size_t& count, const std::size_t& size,
+    const std::uintptr_t& alignment, void** out)
+{
+    if (size > Max)
+        throw std::bad_alloc();
+
+    Child& bucket = GetBucket(BucketFor(size));
+
+    const std::size_t usedBefore = bucket.GetUsed();
+    bucket.AllocateBatch(count, size, alignment, out);
+
+    m_usedBytes += bucket.GetUsed() - usedBefore;
+    m_numAllocations += count;
+}
+
+
+template<typename Child, std::size_t Min, std::size_t Max, std::size_t Step>
+Child& Bucketizer<Child, Min, Max, Step>::GetBucket(const std::size_t& index) noexcept
+{
+    assert(index < kNumBuckets);
+    return *std::launder(reinterpret_cast<Child*>(m_buckets[index]));
+}
+
+
+template<typename Child, std::size_t Min, std::size_t Max, std::size_t Step>
+const Child& Bucketizer<Child, Min, Max, Step>::GetBucket(const std::size_t& index) const noexcept
+{
+    assert(index < kNumBuckets);
+    return *std::launder(reinterpret_cast<const Child*>(m_buckets[index]));
+}
+
+
+template<typename Child, std::size_t Min, std::size_t Max, std::size_t Step>
+constexpr std::size_t Bucketizer<Child, Min, Max, Step>::BucketFor(const std::size_t& size) noexcept
+{
+    return size <= Min ? 0 : (size - Min - 1u) / Step;
+}
+
+
+template<typename Child, std::size_t Min, std::size_t Max, std::size_t Step>
+std::size_t Bucketizer<Child, Min, Max, Step>::BucketOf(const void* const ptr) const noexcept
+{
+    const std::size_t index = (reinterpret_cast<std::uintptr_t>(ptr) - reinterpret_cast<std::uintptr_t>(m_start)) / m_sliceSize;
+    assert(index < kNumBuckets);
+
+    return index;
+}
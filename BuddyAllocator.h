@@ -0,0 +1,337 @@
+﻿#pragma once
+#include <new>
+#include <utility>
+#include "StaticAllocator.h"
+#include "BitOperations.h"
+
+// Binary buddy allocator over a caller-provided region.
+// Blocks are powers of two from kMinBlockSize up, every order keeps its own free list,
+// and m_levelMask has a bit set for each order with a non-empty list. The buddy of a block
+// is found by flipping one bit of its offset, so Allocate and Free are O(log N) and merging
+// never walks memory.
+//
+// The start of the region holds the metadata: a free bitmap and an order table, one entry
+// per kMinBlockSize unit. Blocks are aligned to their size relative to m_base, which is
+// itself aligned to at least kBaseAlignment.
+class BuddyAllocator final : public StaticAllocator<BuddyAllocator>
+{
+public:
+    BuddyAllocator(const std::size_t sizeBytes, void* start) noexcept;
+
+    BuddyAllocator(const BuddyAllocator&) = delete;
+    BuddyAllocator& operator=(const BuddyAllocator&) = delete;
+
+    BuddyAllocator(BuddyAllocator&&) noexcept;
+    BuddyAllocator& operator=(BuddyAllocator&&) noexcept;
+
+    ~BuddyAllocator() noexcept override final; // = default;
+
+    virtual void* Allocate(const std::size_t& size, const std::uintptr_t& alignment = sizeof(std::intptr_t)) override final;
+    virtual void Free(void* const ptr) noexcept override final;
+    using StaticAllocator::Free;
+
+    virtual std::size_t GetAllocationSize(const void* const ptr) const noexcept override final;
+
+    // Size of the block that serves a request, m_usedBytes counts these
+    static std::size_t BlockSizeFor(const std::size_t& size, const std::uintptr_t& alignment) noexcept;
+
+private:
+    struct FreeBlock;
+
+    static constexpr unsigned kMinOrder = 5;
+    static constexpr std::size_t kMinBlockSize = std::size_t(1) << kMinOrder;
+    static constexpr std::size_t kBaseAlignment = 64;
+    static constexpr unsigned kNumLevels = 48;          // orders kMinOrder .. kMinOrder + kNumLevels - 1
+
+    static unsigned LevelFor(const std::size_t& blockSize) noexcept;
+
+    void PushFreeBlock(const std::size_t& index, const unsigned& level) noexcept;
+    void RemoveFreeBlock(const std::size_t& index, const unsigned& level) noexcept;
+    FreeBlock* PopFreeBlock(const unsigned& level) noexcept;
+
+    bool IsFree(const std::size_t& index) const noexcept;
+    void SetFree(const std::size_t& index, const bool& free) noexcept;
+
+    FreeBlock* BlockAt(const std::size_t& index) const noexcept;
+    std::size_t IndexOf(const void* const ptr) const noexcept;
+
+protected:
+    std::uintptr_t m_base;              // address of unit 0
+    std::size_t m_numUnits;             // kMinBlockSize units managed
+    std::size_t m_baseAlignment;        // largest power of two m_base is aligned to
+
+    std::uint64_t* m_freeMap;           // bit per unit, set where a free block starts
+    std::uint8_t* m_levels;             // level of the block starting at each unit
+
+    std::uint64_t m_levelMask;
+    FreeBlock* m_freeLists[kNumLevels];
+};
+
+
+struct BuddyAllocator::FreeBlock
+{
+    FreeBlock* next;
+    FreeBlock* prev;
+};
+
+
+BuddyAllocator::BuddyAllocator(const std::size_t sizeBytes, void* start) noexcept
+    :
+    StaticAllocator(sizeBytes, start),
+    m_base(0), m_numUnits(0), m_baseAlignment(0), m_freeMap(nullptr), m_levels(nullptr),
+    m_levelMask(0), m_freeLists{}
+{
+    assert(reinterpret_cast<std::uintptr_t>(start) % alignof(std::uint64_t) == 0);
+
+    // Upper bound on the units, each one costs kMinBlockSize bytes, a byte of the order table and a bit
+    const std::size_t maxUnits = sizeBytes / (kMinBlockSize + 2u);
+    const std::size_t mapBytes = (maxUnits + 63u) / 64u * sizeof(std::uint64_t);
+
+    const std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(start);
+    const std::uintptr_t end = begin + sizeBytes;
+
+    m_freeMap = reinterpret_cast<std::uint64_t*>(begin);
+    m_levels = reinterpret_cast<std::uint8_t*>(begin + mapBytes);
+    m_base = (begin + mapBytes + maxUnits + kBaseAlignment - 1u) & ~(kBaseAlignment - 1u);
+    m_baseAlignment = m_base & (0u - m_base);
+
+    m_numUnits = m_base < end ? (end - m_base) / kMinBlockSize : 0;
+    if (m_numUnits > maxUnits)
+        m_numUnits = maxUnits;
+
+    assert(m_numUnits > 0);
+
+    for (std::size_t i = 0; i < mapBytes / sizeof(std::uint64_t); ++i)
+        m_freeMap[i] = 0;
+
+    // Cover the units with the largest blocks that fit, each aligned to its own size
+    std::size_t index = 0;
+    while (index < m_numUnits)
+    {
+        unsigned level = FindHighestSetBit(m_numUnits - index);
+        if (index != 0 && FindLowestSetBit(index) < level)
+            level = FindLowestSetBit(index);
+        if (level >= kNumLevels)
+            level = kNumLevels - 1u;
+
+        PushFreeBlock(index, level);
+        index += std::size_t(1) << level;
+    }
+}
+
+
+BuddyAllocator::BuddyAllocator(BuddyAllocator&& other) noexcept
+    :
+    StaticAllocator(std::move(other)),
+    m_base(other.m_base), m_numUnits(other.m_numUnits), m_baseAlignment(other.m_baseAlignment),
+    m_freeMap(other.m_freeMap), m_levels(other.m_levels), m_levelMask(other.m_levelMask)
+{
+    for (unsigned i = 0; i < kNumLevels; ++i)
+    {
+        m_freeLists[i] = other.m_freeLists[i];
+        other.m_freeLists[i] = nullptr;
+    }
+
+    other.m_numUnits = 0;
+    other.m_freeMap = nullptr;
+    other.m_levels = nullptr;
+    other.m_levelMask = 0;
+}
+
+
+BuddyAllocator& BuddyAllocator::operator=(BuddyAllocator&& rhs) noexcept
+{
+    if (this != &rhs) {
+        StaticAllocator::operator=(std::move(rhs));
+        m_base = rhs.m_base;
+        m_numUnits = rhs.m_numUnits;
+        m_baseAlignment = rhs.m_baseAlignment;
+        m_freeMap = rhs.m_freeMap;
+        m_levels = rhs.m_levels;
+        m_levelMask = rhs.m_levelMask;
+
+        for (unsigned i = 0; i < kNumLevels; ++i)
+        {
+            m_freeLists[i] = rhs.m_freeLists[i];
+            rhs.m_freeLists[i] = nullptr;
+        }
+
+        rhs.m_numUnits = 0;
+        rhs.m_freeMap = nullptr;
+        rhs.m_levels = nullptr;
+        rhs.m_levelMask = 0;
+    }
+
+    return *this;
+}
+
+
+BuddyAllocator::~BuddyAllocator() noexcept
+{}
+
+
+void* BuddyAllocator::Allocate(const std::size_t& size, const std::uintptr_t& alignment)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1u)) == 0);
+
+    if (alignment > m_baseAlignment || size > m_numUnits * kMinBlockSize)
+        throw std::bad_alloc();
+
+    const std::size_t blockSize = BlockSizeFor(size, alignment);
+    const unsigned level = LevelFor(blockSize);
+
+    // Smallest non-empty order that can hold the block
+    const std::uint64_t candidates = m_levelMask & (~std::uint64_t(0) << level);
+    if (candidates == 0)
+        throw std::bad_alloc();
+
+    unsigned found = FindLowestSetBit(candidates);
+    const std::size_t index = IndexOf(PopFreeBlock(found));
+
+    // Split down, the upper halves go back to the free lists
+    while (found > level)
+    {
+        --found;
+        PushFreeBlock(index + (std::size_t(1) << found), found);
+    }
+
+    m_levels[index] = static_cast<std::uint8_t>(level);
+
+    m_usedBytes += blockSize;
+    ++m_numAllocations;
+
+    return BlockAt(index);
+}
+
+
+void BuddyAllocator::Free(void* const ptr) noexcept
+{
+    assert(ptr != nullptr);
+
+    std::size_t index = IndexOf(ptr);
+    assert(index < m_numUnits && !IsFree(index));
+
+    unsigned level = m_levels[index];
+
+    m_usedBytes -= kMinBlockSize << level;
+    --m_numAllocations;
+
+    // Merge while the buddy is a whole free block of the same order
+    while (level + 1u < kNumLevels)
+    {
+        const std::size_t buddy = index ^ (std::size_t(1) << level);
+
+        if (buddy >= m_numUnits || !IsFree(buddy) || m_levels[buddy] != level)
+            break;
+
+        RemoveFreeBlock(buddy, level);
+
+        if (buddy < index)
+            index = buddy;
+        ++level;
+    }
+
+    PushFreeBlock(index, level);
+}
+
+
+std::size_t BuddyAllocator::GetAllocationSize(const void* const ptr) const noexcept
+{
+    assert(ptr != nullptr);
+
+    const std::size_t index = IndexOf(ptr);
+    assert(index < m_numUnits && !IsFree(index));
+
+    return kMinBlockSize << m_levels[index];
+}
+
+
+std::size_t BuddyAllocator::BlockSizeFor(const std::size_t& size, const std::uintptr_t& alignment) noexcept
+{
+    std::size_t needed = size > alignment ? size : static_cast<std::size_t>(alignment);
+    if (needed <= kMinBlockSize)
+        return kMinBlockSize;
+
+    return std::size_t(1) << (FindHighestSetBit(needed - 1u) + 1u);
+}
+
+
+unsigned BuddyAllocator::LevelFor(const std::size_t& blockSize) noexcept
+{
+    return FindHighestSetBit(blockSize) - kMinOrder;
+}
+
+
+void BuddyAllocator::PushFreeBlock(const std::size_t& index, const unsigned& level) noexcept
+{
+    FreeBlock* block = BlockAt(index);
+    block->prev = nullptr;
+    block->next = m_freeLists[level];
+
+    if (block->next != nullptr)
+        block->next->prev = block;
+
+    m_freeLists[level] = block;
+    m_levelMask |= std::uint64_t(1) << level;
+
+    m_levels[index] = static_cast<std::uint8_t>(level);
+    SetFree(index, true);
+}
+
+
+void BuddyAllocator::RemoveFreeBlock(const std::size_t& index, const unsigned& level) noexcept
+{
+    FreeBlock* block = BlockAt(index);
+
+    if (block->prev != nullptr)
+        block->prev->next = block->next;
+    else
+        m_freeLists[level] = block->next;
+
+    if (block->next != nullptr)
+        block->next->prev = block->prev;
+
+    if (m_freeLists[level] == nullptr)
+        m_levelMask &= ~(std::uint64_t(1) << level);
+
+    SetFree(index, false);
+}
+
+
+BuddyAllocator::FreeBlock* BuddyAllocator::PopFreeBlock(const unsigned& level) noexcept
+{
+    FreeBlock* block = m_freeLists[level];
+    assert(block != nullptr);
+
+    RemoveFreeBlock(IndexOf(block), level);
+    return block;
+}
+
+
+bool BuddyAllocator::IsFree(const std::size_t& index) const noexcept
+{
+    return (m_freeMap[index / 64u] >> (index % 64u)) & 1u;
+}
+
+
+void BuddyAllocator::SetFree(const std::size_t& index, const bool& free) noexcept
+{
+    const std::uint64_t bit = std::uint64_t(1) << (index % 64u);
+
+    if (free)
+        m_freeMap[index / 64u] |= bit;
+    else
+        m_freeMap[index / 64u] &= ~bit;
+}
+
+
+BuddyAllocator::FreeBlock* BuddyAllocator::BlockAt(const std::size_t& index) const noexcept
+{
+    return reinterpret_cast<FreeBlock*>(m_base + index * kMinBlockSize);
+}
+
+
+std::size_t BuddyAllocator::IndexOf(const void* const ptr) const noexcept
+{
+    return (reinterpret_cast<std::uintptr_t>(ptr) - m_base) / kMinBlockSize;
+}
@@ -0,0 +1,141 @@
+﻿#pragma once
+#include <cstdlib>
+#include <new>
+#include "Allocator.h"
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// Upstream memory for growable allocators.
+// AcquireChunk returns at least size bytes aligned to alignof(std::max_align_t) or throws std::bad_alloc,
+// ReleaseChunk gets back the same pointer and size.
+class ChunkSource
+{
+public:
+    virtual ~ChunkSource() noexcept = default;
+
+    virtual void* AcquireChunk(const std::size_t& size) = 0;
+    virtual void ReleaseChunk(void* const chunk, const std::size_t& size) noexcept = 0;
+};
+
+
+// Chunks from the C heap
+class MallocChunkSource final : public ChunkSource
+{
+public:
+    static MallocChunkSource& Instance() noexcept;
+
+    virtual void* AcquireChunk(const std::size_t& size) override final;
+    virtual void ReleaseChunk(void* const chunk, const std::size_t& size) noexcept override final;
+};
+
+
+// Chunks mapped straight from the OS (mmap / VirtualAlloc), page granular
+class VirtualMemoryChunkSource final : public ChunkSource
+{
+public:
+    static VirtualMemoryChunkSource& Instance() noexcept;
+
+    virtual void* AcquireChunk(const std::size_t& size) override final;
+    virtual void ReleaseChunk(void* const chunk, const std::size_t& size) noexcept override final;
+};
+
+
+// Chunks carved from another allocator, which must outlive every chunk it hands out
+class AllocatorChunkSource final : public ChunkSource
+{
+public:
+    explicit AllocatorChunkSource(Allocator& allocator) noexcept;
+
+    virtual void* AcquireChunk(const std::size_t& size) override final;
+    virtual void ReleaseChunk(void* const chunk, const std::size_t& size) noexcept override final;
+
+private:
+    Allocator& m_allocator;
+};
+
+
+MallocChunkSource& MallocChunkSource::Instance() noexcept
+{
+    static MallocChunkSource source;
+    return source;
+}
+
+
+void* MallocChunkSource::AcquireChunk(const std::size_t& size)
+{
+    void* chunk = std::malloc(size);
+
+    if (chunk == nullptr)
+        throw std::bad_alloc();
+
+    return chunk;
+}
+
+
+void MallocChunkSource::ReleaseChunk(void* const chunk, [[maybe_unused]] const std::size_t& size) noexcept
+{
+    std::free(chunk);
+}
+
+
+VirtualMemoryChunkSource& VirtualMemoryChunkSource::Instance() noexcept
+{
+    static VirtualMemoryChunkSource source;
+    return source;
+}
+
+
+void* VirtualMemoryChunkSource::AcquireChunk(const std::size_t& size)
+{
+#if defined(_WIN32)
+    void* chunk = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+
+    if (chunk == nullptr)
+        throw std::bad_alloc();
+#else
+    void* chunk = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (chunk == MAP_FAILED)
+        throw std::bad_alloc();
+#endif
+
+    return chunk;
+}
+
+
+void VirtualMemoryChunkSource::ReleaseChunk(void* const chunk, [[maybe_unused]] const std::size_t& size) noexcept
+{
+#if defined(_WIN32)
+    VirtualFree(chunk, 0, MEM_RELEASE);
+#else
+    munmap(chunk, size);
+#endif
+}
+
+
+AllocatorChunkSource::AllocatorChunkSource(Allocator& allocator) noexcept
+    :
+    m_allocator(allocator)
+{}
+
+
+void* AllocatorChunkSource::AcquireChunk(const std::size_t& size)
+{
+    return m_allocator.Allocate(size, alignof(std::max_align_t));
+}
+
+
+void AllocatorChunkSource::ReleaseChunk(void* const chunk, [[maybe_unused]] const std::size_t& size) noexcept
+{
+    m_allocator.Free(chunk);
+}
@@ -0,0 +1,411 @@
+﻿#pragma once
+#include <atomic>
+#include <mutex>
+#include <new>
+#include "FreeListAllocatorCustom.h"
+
+// Thread-safe front end for FreeListAllocator.
+// Small requests are served from a per-thread cache of blocks per size class; a cache
+// refills from and flushes to the shared FreeListAllocator in batches under one lock,
+// so most Allocate/Free calls never touch the mutex. Larger or over-aligned requests
+// go to the shared allocator directly.
+//
+// Every block carries a small prefix recording its size class, so a block may be freed
+// by any thread. The Allocator counters mirror the shared allocator (cached blocks count
+// as used) and are updated under the lock; read them while the threads are quiescent.
+class ConcurrentFreeListAllocator final : public StaticAllocator<ConcurrentFreeListAllocator>
+{
+public:
+    ConcurrentFreeListAllocator(const std::size_t sizeBytes, void* start,
+        FreeListAllocator::FitPolicy fitPolicy = FreeListAllocator::FitPolicy::SegregatedFit) noexcept;
+
+    ConcurrentFreeListAllocator(const ConcurrentFreeListAllocator&) = delete;
+    ConcurrentFreeListAllocator& operator=(const ConcurrentFreeListAllocator&) = delete;
+
+    // Thread caches refer to the instance, so it cannot be moved
+    ConcurrentFreeListAllocator(ConcurrentFreeListAllocator&&) = delete;
+    ConcurrentFreeListAllocator& operator=(ConcurrentFreeListAllocator&&) = delete;
+
+    ~ConcurrentFreeListAllocator() noexcept override final;
+
+    virtual void* Allocate(const std::size_t& size, const std::uintptr_t& alignment = sizeof(std::intptr_t)) override final;
+    virtual void Free(void* const ptr) noexcept override final;
+    using StaticAllocator::Free;
+
+    // Small blocks read only their prefix, large blocks read the shared allocator under the lock
+    virtual std::size_t GetAllocationSize(const void* const ptr) const noexcept override final;
+
+    // Returns the calling thread's cached blocks to the shared allocator.
+    // Threads should call it before they exit, otherwise their blocks stay cached until destruction.
+    void ReleaseThreadCache() noexcept;
+
+private:
+    struct CachedBlock;
+    struct ThreadCache;
+    struct BlockPrefix;
+    struct CacheSlot;
+
+    static constexpr std::size_t kClassGranularity = 16;
+    static constexpr std::size_t kNumCacheClasses = 16;                                     // class i serves (i + 1) * 16 bytes
+    static constexpr std::size_t kMaxCachedSize = kNumCacheClasses * kClassGranularity;
+    static constexpr std::size_t kLargeClass = ~std::uint32_t(0);
+    static constexpr std::size_t kPrefixSize = 16;                                          // keeps user pointers 16-byte aligned
+    static constexpr std::size_t kBatchSize = 32;                                           // blocks moved per refill/flush
+    static constexpr std::size_t kMaxCachedBlocks = 2 * kBatchSize;                         // per class, before a flush
+    static constexpr std::size_t kThreadSlots = 4;                                          // instances remembered per thread
+    static constexpr std::size_t kMaxAlignment = std::size_t(1) << 31;                      // the offset must fit BlockPrefix::offset
+
+    static std::uint64_t NextInstanceId() noexcept;
+    static std::uint64_t ThreadSerial() noexcept;
+    static CacheSlot* ThreadSlots() noexcept;
+
+    ThreadCache* GetThreadCache(const bool create) noexcept;
+    void Refill(ThreadCache& cache, const std::size_t& sizeClass) noexcept;
+    void Flush(ThreadCache& cache, const std::size_t& sizeClass, std::size_t count) noexcept;
+    void SyncCounters() noexcept;
+
+protected:
+    FreeListAllocator m_shared;
+    mutable std::mutex m_mutex;
+    ThreadCache* m_threadCaches;            // every registered cache, guarded by m_mutex
+    const std::uint64_t m_instanceId;       // never reused, so a stale thread-local slot cannot match
+};
+
+
+struct ConcurrentFreeListAllocator::CachedBlock {
+    CachedBlock* next;
+};
+
+
+// owner is the ThreadSerial of the thread, std::thread::id may be reused once a thread exits
+// and a new thread would then adopt the cache and counts of a dead one
+struct ConcurrentFreeListAllocator::ThreadCache {
+    std::uint64_t owner;
+    ThreadCache* next;
+    CachedBlock* blocks[kNumCacheClasses];
+    std::size_t counts[kNumCacheClasses];
+};
+
+
+// Thread-local memo of the caches the thread uses
+struct ConcurrentFreeListAllocator::CacheSlot {
+    std::uint64_t instanceId;
+    ThreadCache* cache;
+};
+
+
+// Sits right before the user pointer
+struct ConcurrentFreeListAllocator::BlockPrefix {
+    std::uint32_t sizeClass;    // kLargeClass for blocks served by the shared allocator directly
+    std::uint32_t offset;       // user pointer minus the pointer returned by the shared allocator
+};
+
+
+ConcurrentFreeListAllocator::ConcurrentFreeListAllocator(const std::size_t sizeBytes, void* start,
+    FreeListAllocator::FitPolicy fitPolicy) noexcept
+    :
+    StaticAllocator(sizeBytes, start),
+    m_shared(sizeBytes, start, fitPolicy),
+    m_threadCaches(nullptr),
+    m_instanceId(NextInstanceId())
+{}
+
+
+ConcurrentFreeListAllocator::~ConcurrentFreeListAllocator() noexcept
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    while (m_threadCaches != nullptr)
+    {
+        ThreadCache* cache = m_threadCaches;
+        m_threadCaches = cache->next;
+
+        for (std::size_t sizeClass = 0; sizeClass < kNumCacheClasses; ++sizeClass)
+        {
+            while (cache->blocks[sizeClass] != nullptr)
+            {
+                CachedBlock* block = cache->blocks[sizeClass];
+                cache->blocks[sizeClass] = block->next;
+                m_shared.Free(m_shared.ptr_sub(block, kPrefixSize));
+            }
+        }
+
+        m_shared.Free(cache);
+    }
+
+    SyncCounters();
+}
+
+
+void* ConcurrentFreeListAllocator::Allocate(const std::size_t& size, const std::uintptr_t& alignment)
+{
+    if (size <= kMaxCachedSize && alignment <= kPrefixSize)
+    {
+        const std::size_t sizeClass = size == 0 ? 0 : (size - 1u) / kClassGranularity;
+        ThreadCache* cache = GetThreadCache(true);
+
+        if (cache != nullptr)
+        {
+            if (cache->blocks[sizeClass] == nullptr)
+                Refill(*cache, sizeClass);
+
+            CachedBlock* block = cache->blocks[sizeClass];
+            if (block != nullptr)
+            {
+                cache->blocks[sizeClass] = block->next;
+                --cache->counts[sizeClass];
+                return block;
+            }
+        }
+    }
+
+    if (alignment > kMaxAlignment)
+        throw std::bad_alloc();
+
+    const std::size_t offset = alignment > kPrefixSize ? alignment : kPrefixSize;
+    if (size > ~std::size_t(0) - offset)
+        throw std::bad_alloc();
+
+    void* raw = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        raw = m_shared.Allocate(size + offset, offset);
+        SyncCounters();
+    }
+
+    void* ptr = m_shared.ptr_add(raw, offset);
+    BlockPrefix* prefix = reinterpret_cast<BlockPrefix*>(m_shared.ptr_sub(ptr, sizeof(BlockPrefix)));
+    prefix->sizeClass = static_cast<std::uint32_t>(kLargeClass);
+    prefix->offset = static_cast<std::uint32_t>(offset);
+
+    return ptr;
+}
+
+
+void ConcurrentFreeListAllocator::Free(void* const ptr) noexcept
+{
+    assert(ptr != nullptr);
+
+    const BlockPrefix* prefix = reinterpret_cast<const BlockPrefix*>(m_shared.ptr_sub(ptr, sizeof(BlockPrefix)));
+
+    if (prefix->sizeClass != kLargeClass)
+    {
+        const std::size_t sizeClass = prefix->sizeClass;
+        assert(sizeClass < kNumCacheClasses);
+
+        ThreadCache* cache = GetThreadCache(true);
+        if (cache != nullptr)
+        {
+            CachedBlock* block = reinterpret_cast<CachedBlock*>(ptr);
+            block->next = cache->blocks[sizeClass];
+            cache->blocks[sizeClass] = block;
+
+            if (++cache->counts[sizeClass] > kMaxCachedBlocks)
+                Flush(*cache, sizeClass, kBatchSize);
+
+            return;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_shared.Free(m_shared.ptr_sub(ptr, prefix->offset));
+    SyncCounters();
+}
+
+
+std::size_t ConcurrentFreeListAllocator::GetAllocationSize(const void* const ptr) const noexcept
+{
+    assert(ptr != nullptr);
+
+    const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(ptr);
+    const BlockPrefix* prefix = reinterpret_cast<const BlockPrefix*>(address - sizeof(BlockPrefix));
+
+    if (prefix->sizeClass != kLargeClass)
+        return (prefix->sizeClass + 1u) * kClassGranularity;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_shared.GetAllocationSize(reinterpret_cast<const void*>(address - prefix->offset)) - prefix->offset;
+}
+
+
+void ConcurrentFreeListAllocator::ReleaseThreadCache() noexcept
+{
+    ThreadCache* cache = GetThreadCache(false);
+    if (cache == nullptr)
+        return;
+
+    for (std::size_t sizeClass = 0; sizeClass < kNumCacheClasses; ++sizeClass)
+        Flush(*cache, sizeClass, cache->counts[sizeClass]);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        ThreadCache** link = &m_threadCaches;
+        while (*link != cache)
+            link = &(*link)->next;
+        *link = cache->next;
+
+        m_shared.Free(cache);
+        SyncCounters();
+    }
+
+    for (CacheSlot* slot = ThreadSlots(); slot != ThreadSlots() + kThreadSlots; ++slot)
+    {
+        if (slot->instanceId == m_instanceId)
+        {
+            slot->instanceId = 0;
+            slot->cache = nullptr;
+        }
+    }
+}
+
+
+std::uint64_t ConcurrentFreeListAllocator::NextInstanceId() noexcept
+{
+    static std::atomic<std::uint64_t> nextId{ 1 };
+    return nextId.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+// Numbers threads in the order they first use any instance, never reused
+std::uint64_t ConcurrentFreeListAllocator::ThreadSerial() noexcept
+{
+    static std::atomic<std::uint64_t> nextSerial{ 1 };
+    static thread_local const std::uint64_t serial = nextSerial.fetch_add(1, std::memory_order_relaxed);
+    return serial;
+}
+
+
+ConcurrentFreeListAllocator::CacheSlot* ConcurrentFreeListAllocator::ThreadSlots() noexcept
+{
+    static thread_local CacheSlot slots[kThreadSlots] = {};
+    return slots;
+}
+
+
+// Looks the calling thread's cache up in a few thread-local slots, falls back to the
+// registry under the lock and, when create is set, registers a new cache carved from the arena
+ConcurrentFreeListAllocator::ThreadCache* ConcurrentFreeListAllocator::GetThreadCache(const bool create) noexcept
+{
+    CacheSlot* slots = ThreadSlots();
+
+    for (std::size_t i = 0; i < kThreadSlots; ++i)
+    {
+        if (slots[i].instanceId == m_instanceId)
+            return slots[i].cache;
+    }
+
+    const std::uint64_t self = ThreadSerial();
+    ThreadCache* cache = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for (ThreadCache* it = m_threadCaches; it != nullptr; it = it->next)
+        {
+            if (it->owner == self)
+            {
+                cache = it;
+                break;
+            }
+        }
+
+        if (cache == nullptr && create)
+        {
+            try
+            {
+                cache = new (m_shared.Allocate(sizeof(ThreadCache), alignof(ThreadCache))) ThreadCache;
+            }
+            catch (const std::bad_alloc&)
+            {
+                return nullptr;
+            }
+
+            cache->owner = self;
+            cache->next = m_threadCaches;
+            for (std::size_t sizeClass = 0; sizeClass < kNumCacheClasses; ++sizeClass)
+            {
+                cache->blocks[sizeClass] = nullptr;
+                cache->counts[sizeClass] = 0;
+            }
+
+            m_threadCaches = cache;
+            SyncCounters();
+        }
+    }
+
+    if (cache != nullptr)
+    {
+        // Evict the oldest memo, slot 0 always holds the most recent one
+        for (std::size_t i = kThreadSlots - 1u; i > 0; --i)
+            slots[i] = slots[i - 1u];
+
+        slots[0].instanceId = m_instanceId;
+        slots[0].cache = cache;
+    }
+
+    return cache;
+}
+
+
+void ConcurrentFreeListAllocator::Refill(ThreadCache& cache, const std::size_t& sizeClass) noexcept
+{
+    const std::size_t blockSize = kPrefixSize + (sizeClass + 1u) * kClassGranularity;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (std::size_t i = 0; i < kBatchSize; ++i)
+    {
+        void* raw = nullptr;
+
+        try
+        {
+            raw = m_shared.Allocate(blockSize, kPrefixSize);
+        }
+        catch (const std::bad_alloc&)
+        {
+            break;
+        }
+
+        void* ptr = m_shared.ptr_add(raw, kPrefixSize);
+        BlockPrefix* prefix = reinterpret_cast<BlockPrefix*>(m_shared.ptr_sub(ptr, sizeof(BlockPrefix)));
+        prefix->sizeClass = static_cast<std::uint32_t>(sizeClass);
+        prefix->offset = static_cast<std::uint32_t>(kPrefixSize);
+
+        CachedBlock* block = reinterpret_cast<CachedBlock*>(ptr);
+        block->next = cache.blocks[sizeClass];
+        cache.blocks[sizeClass] = block;
+        ++cache.counts[sizeClass];
+    }
+
+    SyncCounters();
+}
+
+
+void ConcurrentFreeListAllocator::Flush(ThreadCache& cache, const std::size_t& sizeClass, std::size_t count) noexcept
+{
+    if (count == 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    while (count-- > 0 && cache.blocks[sizeClass] != nullptr)
+    {
+        CachedBlock* block = cache.blocks[sizeClass];
+        cache.blocks[sizeClass] = block->next;
+        --cache.counts[sizeClass];
+
+        m_shared.Free(m_shared.ptr_sub(block, kPrefixSize));
+    }
+
+    SyncCounters();
+}
+
+
+// Called with m_mutex held
+void ConcurrentFreeListAllocator::SyncCounters() noexcept
+{
+    m_usedBytes = m_shared.GetUsed();
+    m_numAllocations = m_shared.GetNumAllocation();
+}
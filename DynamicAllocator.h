@@ -1,17 +1,347 @@
-﻿#pragma once
-#include "Allocator.h"
-
-class DynamicAllocator : public Allocator {
-public:
-    struct BlockDesc {
-        BlockDesc* prevBlock;
-    };
-
-    DynamicAllocator(std::size_t sizeBytes, void* start)
-        : Allocator(sizeBytes, start) {
-        m_currentBlock = reinterpret_cast<BlockDesc*>(start);
-        m_currentBlock->prevBlock = nullptr;
-    }
-
-    BlockDesc* m_currentBlock;
-};
+﻿#pragma once
+#include <cstdint>
+#include <utility>
+#include "FreeListAllocatorCustom.h"
+#include "ChunkSource.h"
+
+// Growable allocator: a chain of chunks, each managed by its own FreeListAllocator.
+// The first chunk is the caller-provided region, further chunks come from the upstream
+// ChunkSource when no chunk can serve a request, so Allocate only throws when the upstream does
+// or the request is beyond kMaxRequestSize. Every new chunk is twice the size of the previous one
+// (up to kMaxChunkSize), which keeps the chain short after a burst; a request larger than that
+// gets a chunk of its own size.
+//
+// Chunk layout: | BlockDesc | FreeListAllocator | arena ... |
+// GetStart is the first chunk, GetSize is the capacity of all chunks together.
+class DynamicAllocator final : public StaticAllocator<DynamicAllocator, Allocator> {
+public:
+    struct BlockDesc {
+        BlockDesc* prevBlock;           // older chunk, nullptr for the caller-provided one
+        std::size_t chunkSize;          // whole chunk, including the descriptor
+        bool ownedChunk;                // obtained from the upstream
+        FreeListAllocator* arena;
+    };
+
+    DynamicAllocator(std::size_t sizeBytes, void* start, ChunkSource& upstream = MallocChunkSource::Instance(),
+        FreeListAllocator::FitPolicy fitPolicy = FreeListAllocator::FitPolicy::SegregatedFit) noexcept;
+
+    DynamicAllocator(const DynamicAllocator&) = delete;
+    DynamicAllocator& operator=(const DynamicAllocator&) = delete;
+
+    DynamicAllocator(DynamicAllocator&&) noexcept;
+    DynamicAllocator& operator=(DynamicAllocator&&) noexcept;
+
+    ~DynamicAllocator() noexcept override;
+
+    virtual void* Allocate(const std::size_t& size, const std::uintptr_t& alignment = sizeof(std::intptr_t)) override;
+    virtual void Free(void* const ptr) noexcept override;
+    using StaticAllocator::Free;
+
+    virtual std::size_t GetAllocationSize(const void* const ptr) const noexcept override;
+
+    // Any chunk of the chain, not only the first
+    virtual bool Owns(const void* const ptr) const noexcept override;
+
+    // Only within the chunk that holds ptr
+    virtual bool TryExpandInPlace(void* const ptr, const std::size_t& newSize) noexcept override;
+
+    // Gives empty upstream chunks back, returns the number of bytes released
+    std::size_t ReleaseUnusedChunks() noexcept;
+
+    std::size_t GetChunkCount() const noexcept;
+
+    BlockDesc* m_currentBlock;          // newest chunk
+
+private:
+    static constexpr std::size_t kMaxChunkSize = std::size_t(1) << 30;     // doubling stops here, larger requests get a chunk of their own size
+
+    // Half the largest FreeListAllocator arena, so the size of a chunk for it cannot overflow
+    static constexpr std::size_t kMaxRequestSize = static_cast<std::size_t>(
+        FreeListAllocator::kMaxArenaSize / 2u < SIZE_MAX / 4u ? FreeListAllocator::kMaxArenaSize / 2u : SIZE_MAX / 4u);
+
+    static constexpr std::size_t ArenaObjectOffset() noexcept;
+    static constexpr std::size_t ArenaOffset() noexcept;
+
+    BlockDesc* CreateBlock(void* const chunk, const std::size_t& chunkSize, const bool& ownedChunk) noexcept;
+    void DestroyBlock(BlockDesc* const block) noexcept;
+    void ReleaseAllBlocks() noexcept;
+
+    BlockDesc* Grow(const std::size_t& size, const std::uintptr_t& alignment);
+    BlockDesc* FindBlock(const void* const ptr) const noexcept;
+    void* AllocateFromBlock(BlockDesc* const block, const std::size_t& size, const std::uintptr_t& alignment) noexcept;
+
+protected:
+    ChunkSource* m_upstream;
+    FreeListAllocator::FitPolicy m_fitPolicy;
+    std::size_t m_nextChunkSize;
+};
+
+
+DynamicAllocator::DynamicAllocator(std::size_t sizeBytes, void* start, ChunkSource& upstream,
+    FreeListAllocator::FitPolicy fitPolicy) noexcept
+    :
+    StaticAllocator(sizeBytes, start), m_currentBlock(nullptr),
+    m_upstream(&upstream), m_fitPolicy(fitPolicy), m_nextChunkSize(sizeBytes)
+{
+    assert(reinterpret_cast<std::uintptr_t>(start) % alignof(BlockDesc) == 0);
+    assert(sizeBytes > ArenaOffset());
+
+    m_currentBlock = CreateBlock(start, sizeBytes, false);
+}
+
+
+DynamicAllocator::DynamicAllocator(DynamicAllocator&& other) noexcept
+    :
+    StaticAllocator(std::move(other)), m_currentBlock(other.m_currentBlock),
+    m_upstream(other.m_upstream), m_fitPolicy(other.m_fitPolicy), m_nextChunkSize(other.m_nextChunkSize)
+{
+    other.m_currentBlock = nullptr;
+}
+
+
+DynamicAllocator& DynamicAllocator::operator=(DynamicAllocator&& rhs) noexcept
+{
+    if (this != &rhs)
+    {
+        ReleaseAllBlocks();
+
+        Allocator::operator=(std::move(rhs));
+        m_currentBlock = rhs.m_currentBlock;
+        m_upstream = rhs.m_upstream;
+        m_fitPolicy = rhs.m_fitPolicy;
+        m_nextChunkSize = rhs.m_nextChunkSize;
+
+        rhs.m_currentBlock = nullptr;
+    }
+
+    return *this;
+}
+
+
+DynamicAllocator::~DynamicAllocator() noexcept
+{
+    ReleaseAllBlocks();
+}
+
+
+void* DynamicAllocator::Allocate(const std::size_t& size, const std::uintptr_t& alignment)
+{
+    // Newest chunk first, it is the one most likely to have room
+    for (BlockDesc* block = m_currentBlock; block != nullptr; block = block->prevBlock)
+    {
+        void* ptr = AllocateFromBlock(block, size, alignment);
+        if (ptr != nullptr)
+            return ptr;
+    }
+
+    BlockDesc* block = Grow(size, alignment);
+    void* ptr = AllocateFromBlock(block, size, alignment);
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+
+    return ptr;
+}
+
+
+void DynamicAllocator::Free(void* const ptr) noexcept
+{
+    assert(ptr != nullptr);
+
+    BlockDesc* block = FindBlock(ptr);
+    assert(block != nullptr);
+
+    const std::size_t usedBefore = block->arena->GetUsed();
+    block->arena->Free(ptr);
+
+    m_usedBytes -= usedBefore - block->arena->GetUsed();
+    --m_numAllocations;
+}
+
+
+std::size_t DynamicAllocator::GetAllocationSize(const void* const ptr) const noexcept
+{
+    assert(ptr != nullptr);
+
+    const BlockDesc* block = FindBlock(ptr);
+    assert(block != nullptr);
+
+    return block->arena->GetAllocationSize(ptr);
+}
+
+
+bool DynamicAllocator::Owns(const void* const ptr) const noexcept
+{
+    return FindBlock(ptr) != nullptr;
+}
+
+
+bool DynamicAllocator::TryExpandInPlace(void* const ptr, const std::size_t& newSize) noexcept
+{
+    assert(ptr != nullptr);
+
+    BlockDesc* block = FindBlock(ptr);
+    assert(block != nullptr);
+
+    const std::size_t usedBefore = block->arena->GetUsed();
+    if (!block->arena->TryExpandInPlace(ptr, newSize))
+        return false;
+
+    m_usedBytes = m_usedBytes - usedBefore + block->arena->GetUsed();
+    return true;
+}
+
+
+std::size_t DynamicAllocator::ReleaseUnusedChunks() noexcept
+{
+    std::size_t releasedBytes = 0;
+    BlockDesc** link = &m_currentBlock;
+
+    while (*link != nullptr)
+    {
+        BlockDesc* block = *link;
+
+        if (block->ownedChunk && block->arena->GetNumAllocation() == 0)
+        {
+            *link = block->prevBlock;
+            releasedBytes += block->chunkSize;
+            DestroyBlock(block);
+        }
+        else
+        {
+            link = &block->prevBlock;
+        }
+    }
+
+    m_size -= releasedBytes;
+    return releasedBytes;
+}
+
+
+std::size_t DynamicAllocator::GetChunkCount() const noexcept
+{
+    std::size_t count = 0;
+
+    for (const BlockDesc* block = m_currentBlock; block != nullptr; block = block->prevBlock)
+        ++count;
+
+    return count;
+}
+
+
+constexpr std::size_t DynamicAllocator::ArenaObjectOffset() noexcept
+{
+    return (sizeof(BlockDesc) + alignof(FreeListAllocator) - 1u) & ~(alignof(FreeListAllocator) - 1u);
+}
+
+
+constexpr std::size_t DynamicAllocator::ArenaOffset() noexcept
+{
+    return (ArenaObjectOffset() + sizeof(FreeListAllocator) + alignof(std::max_align_t) - 1u) & ~(alignof(std::max_align_t) - 1u);
+}
+
+
+DynamicAllocator::BlockDesc* DynamicAllocator::CreateBlock(void* const chunk, const std::size_t& chunkSize,
+    const bool& ownedChunk) noexcept
+{
+    const std::uintptr_t chunkStart = reinterpret_cast<std::uintptr_t>(chunk);
+
+    BlockDesc* block = new (chunk) BlockDesc;
+    block->prevBlock = m_currentBlock;
+    block->chunkSize = chunkSize;
+    block->ownedChunk = ownedChunk;
+    block->arena = new (reinterpret_cast<void*>(chunkStart + ArenaObjectOffset()))
+        FreeListAllocator(chunkSize - ArenaOffset(), reinterpret_cast<void*>(chunkStart + ArenaOffset()), m_fitPolicy);
+
+    return block;
+}
+
+
+void DynamicAllocator::DestroyBlock(BlockDesc* const block) noexcept
+{
+    block->arena->~FreeListAllocator();
+
+    if (block->ownedChunk)
+        m_upstream->ReleaseChunk(block, block->chunkSize);
+}
+
+
+void DynamicAllocator::ReleaseAllBlocks() noexcept
+{
+    while (m_currentBlock != nullptr)
+    {
+        BlockDesc* block = m_currentBlock;
+        m_currentBlock = block->prevBlock;
+        DestroyBlock(block);
+    }
+}
+
+
+DynamicAllocator::BlockDesc* DynamicAllocator::Grow(const std::size_t& size, const std::uintptr_t& alignment)
+{
+    if (size > kMaxRequestSize || alignment > kMaxRequestSize)
+        throw std::bad_alloc();
+
+    // Room for the request in a fresh arena: the worst-case alignment padding plus the
+    // allocation header and the remainder block FreeListAllocator keeps after a split
+    const std::size_t required = ArenaOffset() + size + alignment + 2u * alignof(std::max_align_t) + 128u;
+
+    std::size_t chunkSize = m_nextChunkSize < kMaxChunkSize ? m_nextChunkSize : kMaxChunkSize;
+    if (chunkSize < required)
+        chunkSize = required;
+
+    void* chunk = nullptr;
+
+    try
+    {
+        chunk = m_upstream->AcquireChunk(chunkSize);
+    }
+    catch (const std::bad_alloc&)
+    {
+        // The upstream may still have room for a chunk that only fits this request
+        if (chunkSize == required)
+            throw;
+
+        chunkSize = required;
+        chunk = m_upstream->AcquireChunk(chunkSize);
+    }
+
+    assert(reinterpret_cast<std::uintptr_t>(chunk) % alignof(BlockDesc) == 0);
+
+    m_currentBlock = CreateBlock(chunk, chunkSize, true);
+    m_size += chunkSize;
+    m_nextChunkSize = chunkSize < kMaxChunkSize / 2u ? chunkSize * 2u : kMaxChunkSize;
+
+    return m_currentBlock;
+}
+
+
+DynamicAllocator::BlockDesc* DynamicAllocator::FindBlock(const void* const ptr) const noexcept
+{
+    const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(ptr);
+
+    for (BlockDesc* block = m_currentBlock; block != nullptr; block = block->prevBlock)
+    {
+        const std::uintptr_t arenaStart = reinterpret_cast<std::uintptr_t>(block->arena->GetStart());
+
+        if (address >= arenaStart && address < arenaStart + block->arena->GetSize())
+            return block;
+    }
+
+    return nullptr;
+}
+
+
+void* DynamicAllocator::AllocateFromBlock(BlockDesc* const block, const std::size_t& size,
+    const std::uintptr_t& alignment) noexcept
+{
+    const std::size_t usedBefore = block->arena->GetUsed();
+    void* ptr = block->arena->TryAllocate(size, alignment);
+
+    if (ptr != nullptr)
+    {
+        m_usedBytes += block->arena->GetUsed() - usedBefore;
+        ++m_numAllocations;
+    }
+
+    return ptr;
+}
@@ -0,0 +1,214 @@
+﻿#pragma once
+#include <new>
+#include "StaticAllocator.h"
+
+// Serves every request from Primary and turns to Secondary only when Primary throws std::bad_alloc,
+// e.g. a fixed FreeListAllocator arena backed by a DynamicAllocator for overflow. Both allocators
+// are borrowed and must outlive the FallbackAllocator. Free, resizing and size queries go to
+// whichever allocator owns the pointer, Primary is asked first.
+//
+// GetStart is the start of Primary, GetSize the two sizes together, the counters track the
+// allocations made through the FallbackAllocator.
+template<typename Primary, typename Secondary>
+class FallbackAllocator final : public StaticAllocator<FallbackAllocator<Primary, Secondary>, Allocator>
+{
+    using Base = StaticAllocator<FallbackAllocator<Primary, Secondary>, Allocator>;
+
+public:
+    FallbackAllocator(Primary& primary, Secondary& secondary) noexcept;
+
+    FallbackAllocator(const FallbackAllocator&) = delete;
+    FallbackAllocator& operator=(const FallbackAllocator&) = delete;
+
+    FallbackAllocator(FallbackAllocator&&) = delete;
+    FallbackAllocator& operator=(FallbackAllocator&&) = delete;
+
+    ~FallbackAllocator() noexcept override final;
+
+    virtual void* Allocate(const std::size_t& size, const std::uintptr_t& alignment = sizeof(std::intptr_t)) override final;
+    virtual void Free(void* const ptr) noexcept override final;
+    virtual void Free(void* const ptr, const std::size_t& size) noexcept override final;
+
+    virtual std::size_t GetAllocationSize(const void* const ptr) const noexcept override final;
+    virtual bool Owns(const void* const ptr) const noexcept override final;
+
+    // Only within the allocator that holds ptr
+    virtual bool TryExpandInPlace(void* const ptr, const std::size_t& newSize) noexcept override final;
+
+    // The whole batch from Primary, or the whole batch from Secondary when Primary cannot serve all of it
+    virtual void AllocateBatch(const std::size_t& count, const std::size_t& size, const std::uintptr_t& alignment,
+        void** out) override final;
+
+    Primary& GetPrimary() const noexcept;
+    Secondary& GetSecondary() const noexcept;
+
+private:
+    template<typename Target>
+    void FreeTo(Target& target, void* const ptr, const std::size_t& size) noexcept;
+    template<typename Target>
+    bool ExpandIn(Target& target, void* const ptr, const std::size_t& newSize) noexcept;
+
+protected:
+    using Base::m_usedBytes;
+    using Base::m_numAllocations;
+
+    Primary& m_primary;
+    Secondary& m_secondary;
+};
+
+
+template<typename Primary, typename Secondary>
+FallbackAllocator<Primary, Secondary>::FallbackAllocator(Primary& primary, Secondary& secondary) noexcept
+    :
+    Base(primary.GetSize() + secondary.GetSize(), const_cast<void*>(primary.GetStart())),
+    m_primary(primary), m_secondary(secondary)
+{}
+
+
+template<typename Primary, typename Secondary>
+FallbackAllocator<Primary, Secondary>::~FallbackAllocator() noexcept
+{}
+
+
+template<typename Primary, typename Secondary>
+void* FallbackAllocator<Primary, Secondary>::Allocate(const std::size_t& size, const std::uintptr_t& alignment)
+{
+    void* ptr;
+
+    const std::size_t primaryBefore = m_primary.GetUsed();
+    const std::size_t secondaryBefore = m_secondary.GetUsed();
+
+    try
+    {
+        ptr = m_primary.Allocate(size, alignment);
+    }
+    catch (const std::bad_alloc&)
+    {
+        ptr = m_secondary.Allocate(size, alignment);
+    }
+
+    m_usedBytes += m_primary.GetUsed() - primaryBefore + m_secondary.GetUsed() - secondaryBefore;
+    ++m_numAllocations;
+
+    return ptr;
+}
+
+
+template<typename Primary, typename Secondary>
+void FallbackAllocator<Primary, Secondary>::Free(void* const ptr) noexcept
+{
+    assert(ptr != nullptr);
+
+    if (m_primary.Owns(ptr))
+        FreeTo(m_primary, ptr, 0);
+    else
+        FreeTo(m_secondary, ptr, 0);
+}
+
+
+template<typename Primary, typename Secondary>
+void FallbackAllocator<Primary, Secondary>::Free(void* const ptr, const std::size_t& size) noexcept
+{
+    assert(ptr != nullptr);
+
+    if (m_primary.Owns(ptr))
+        FreeTo(m_primary, ptr, size);
+    else
+        FreeTo(m_secondary, ptr, size);
+}
+
+
+template<typename Primary, typename Secondary>
+std::size_t FallbackAllocator<Primary, Secondary>::GetAllocationSize(const void* const ptr) const noexcept
+{
+    if (m_primary.Owns(ptr))
+        return m_primary.GetAllocationSize(ptr);
+
+    return m_secondary.GetAllocationSize(ptr);
+}
+
+
+template<typename Primary, typename Secondary>
+bool FallbackAllocator<Primary, Secondary>::Owns(const void* const ptr) const noexcept
+{
+    return m_primary.Owns(ptr) || m_secondary.Owns(ptr);
+}
+
+
+template<typename Primary, typename Secondary>
+bool FallbackAllocator<Primary, Secondary>::TryExpandInPlace(void* const ptr, const std::size_t& newSize) noexcept
+{
+    assert(ptr != nullptr);
+
+    if (m_primary.Owns(ptr))
+        return ExpandIn(m_primary, ptr, newSize);
+
+    return ExpandIn(m_secondary, ptr, newSize);
+}
+
+
+template<typename Primary, typename Secondary>
+void FallbackAllocator<Primary, Secondary>::AllocateBatch(const std::size_t& count, const std::size_t& size,
+    const std::uintptr_t& alignment, void** out)
+{
+    const std::size_t primaryBefore = m_primary.GetUsed();
+    const std::size_t secondaryBefore = m_secondary.GetUsed();
+
+    try
+    {
+        m_primary.AllocateBatch(count, size, alignment, out);
+    }
+    catch (const std::bad_alloc&)
+    {
+        m_secondary.AllocateBatch(count, size, alignment, out);
+    }
+
+    m_usedBytes += m_primary.GetUsed() - primaryBefore + m_secondary.GetUsed() - secondaryBefore;
+    m_numAllocations += count;
+}
+
+
+template<typename Primary, typename Secondary>
+Primary& FallbackAllocator<Primary, Secondary>::GetPrimary() const noexcept
+{
+    return m_primary;
+}
+
+
+template<typename Primary, typename Secondary>
+Secondary& FallbackAllocator<Primary, Secondary>::GetSecondary() const noexcept
+{
+    return m_secondary;
+}
+
+
+// size 0 means unknown and takes the unsized Free of the target
+template<typename Primary, typename Secondary>
+template<typename Target>
+void FallbackAllocator<Primary, Secondary>::FreeTo(Target& target, void* const ptr, const std::size_t& size) noexcept
+{
+    assert(m_numAllocations > 0);
+
+    const std::size_t usedBefore = target.GetUsed();
+
+    if (size == 0)
+        target.Free(ptr);
+    else
+        target.Free(ptr, size);
+
+    m_usedBytes -= usedBefore - target.GetUsed();
+    --m_numAllocations;
+}
+
+
+template<typename Primary, typename Secondary>
+template<typename Target>
+bool FallbackAllocator<Primary, Secondary>::ExpandIn(Target& target, void* const ptr, const std::size_t& newSize) noexcept
+{
+    const std::size_t usedBefore = target.GetUsed();
+    if (!target.TryExpandInPlace(ptr, newSize))
+        return false;
+
+    m_usedBytes = m_usedBytes - usedBefore + target.GetUsed();
+    return true;
+}
@@ -1,29 +1,84 @@
-﻿#include <iostream>
-#include <vector>
-#include "STLAdaptor.h"
-#include "FreeListAllocatorCustom.h"
-#include "DynamicAllocator.h"
-
-int main() {
-    const std::size_t memSize = 300;
-    void* memory = std::malloc(memSize);
-
-    FreeListAllocator myAlloc(memSize, memory);
-
-    STLAdaptor<int, FreeListAllocator> a(myAlloc);
-    STLAdaptor<int, FreeListAllocator> b(myAlloc);
-
-    if (a == b) {
-        std::cout << "Same allocator!\n";
-    }
-    else {
-        std::cout << "Different allocator!\n";
-    }
-
-    std::vector<int, STLAdaptor<int, FreeListAllocator>> vec(a);
-    vec.push_back(1);
-    vec.push_back(2);
-    vec.push_back(3);
-
-    return 0;
-}
+﻿#include <cstdio>
+#include <iostream>
+#include <vector>
+#include "STLAdaptor.h"
+#include "FreeListAllocatorCustom.h"
+#include "DynamicAllocator.h"
+
+// Average block size per allocation for both header policies, the difference is the saving
+static void ReportHeaderOverhead()
+{
+    using FitPolicy = FreeListAllocator::FitPolicy;
+    using ZeroPolicy = FreeListAllocator::ZeroPolicy;
+    using HeaderPolicy = FreeListAllocator::HeaderPolicy;
+
+    const std::size_t arenaSize = 8 * 1024 * 1024;
+    const std::size_t count = 10000;
+    const std::size_t objectSizes[] = { 8, 16, 24, 32, 48, 64, 128, 256 };
+
+    void* arena = std::malloc(arenaSize);
+    std::vector<void*> pointers(count);
+
+    std::cout << "object  standard  compact  saved\n";
+
+    for (const std::size_t objectSize : objectSizes)
+    {
+        double bytesPerAllocation[2] = {};
+
+        for (const HeaderPolicy headerPolicy : { HeaderPolicy::Standard, HeaderPolicy::Compact })
+        {
+            FreeListAllocator allocator(arenaSize, arena, FitPolicy::SegregatedFit, ZeroPolicy::None, headerPolicy);
+
+            for (std::size_t i = 0; i < count; ++i)
+                pointers[i] = allocator.Allocate(objectSize);
+
+            bytesPerAllocation[static_cast<int>(headerPolicy)] = static_cast<double>(allocator.GetUsed()) / count;
+
+            for (std::size_t i = 0; i < count; ++i)
+                allocator.Free(pointers[i]);
+        }
+
+        std::printf("%6zu  %8.1f  %7.1f  %4.1f%%\n", objectSize, bytesPerAllocation[0], bytesPerAllocation[1],
+            100.0 * (bytesPerAllocation[0] - bytesPerAllocation[1]) / bytesPerAllocation[0]);
+    }
+
+    std::free(arena);
+}
+
+// Prints what STLAdaptor asks of the allocator
+static void PrintTraceEvent(const TraceEvent& event, void*)
+{
+    if (event.op == TraceOp::Allocate)
+        std::printf("Allocation --> STLAdapt: %zu bytes at %p\n", event.size, event.address);
+    else if (event.op == TraceOp::Free)
+        std::printf("Deallocation <-- STLAdapt: %p\n", event.address);
+}
+
+int main() {
+    const std::size_t memSize = 300;
+    void* memory = std::malloc(memSize);
+
+    FreeListAllocator myAlloc(memSize, memory);
+
+    using Adaptor = STLAdaptor<int, FreeListAllocator, CallbackTrace>;
+    CallbackTrace::SetCallback(PrintTraceEvent);
+
+    Adaptor a(myAlloc);
+    Adaptor b(myAlloc);
+
+    if (a == b) {
+        std::cout << "Same allocator!\n";
+    }
+    else {
+        std::cout << "Different allocator!\n";
+    }
+
+    std::vector<int, Adaptor> vec(a);
+    vec.push_back(1);
+    vec.push_back(2);
+    vec.push_back(3);
+
+    ReportHeaderOverhead();
+
+    return 0;
+}
@@ -1,262 +1,1652 @@
-﻿#pragma once
-#include "FixedAllocator.h"
-
-// Not an Abstract class
-class FreeListAllocator : public FixedAllocator
-{
-public:
-    FreeListAllocator(const std::size_t sizeBytes, void* start) noexcept;
-
-    FreeListAllocator(const FreeListAllocator&) = delete;
-    FreeListAllocator& operator=(const FreeListAllocator&) = delete;
-
-    FreeListAllocator(FreeListAllocator&&) noexcept;
-    FreeListAllocator& operator=(FreeListAllocator&&) noexcept;
-
-    ~FreeListAllocator() noexcept override final; // = default;
-
-    virtual void* Allocate(const std::size_t& size, const std::uintptr_t& alignment = sizeof(std::intptr_t)) override final;
-    virtual void Free(void* const ptr) noexcept override final;
-    void ZeroedAddresses(std::uint8_t* ptr_addr, std::uint8_t* zero_addr) noexcept;
-
-    template<typename T>
-    inline std::size_t align_forward_adjustment_with_header(const void* const ptr, const std::size_t& alignment) noexcept;
-    inline void* ptr_add(const void* const p, const std::uintptr_t& amount) noexcept;
-    inline void* ptr_sub(const void* const ptr, const std::uintptr_t& sizeHeader) noexcept;
-
-private:
-    struct FreeBlock;
-    struct AllocationHeader;
-
-protected:
-    FreeBlock* m_freeBlocks;
-};
-
-
-struct FreeListAllocator::FreeBlock {
-    int size;
-    FreeBlock* next;
-    FreeBlock* prev;
-};
-
-
-struct FreeListAllocator::AllocationHeader {
-    int size;
-    uintptr_t adjustment;
-};
-
-
-FreeListAllocator::FreeListAllocator(const std::size_t sizeBytes, void* start) noexcept
-    :
-    FixedAllocator(sizeBytes, start), m_freeBlocks((FreeBlock*)start)
-{
-    assert(sizeBytes > sizeof(FreeBlock));
-    m_freeBlocks->size = sizeBytes;
-    m_freeBlocks->next = nullptr;
-    m_freeBlocks->prev = nullptr;
-}
-
-
-FreeListAllocator::FreeListAllocator(FreeListAllocator&& other) noexcept
-    :
-    FixedAllocator(std::move(other)),
-    m_freeBlocks(other.m_freeBlocks)
-{
-    other.m_freeBlocks = nullptr;
-}
-
-
-FreeListAllocator& FreeListAllocator::operator=(FreeListAllocator&& rhs) noexcept
-{
-    if (this != &rhs) {
-        Allocator::operator=(std::move(rhs));
-        m_freeBlocks = rhs.m_freeBlocks;
-        rhs.m_freeBlocks = nullptr;
-    }
-
-    return *this;
-}
-
-
-FreeListAllocator::~FreeListAllocator() noexcept
-{
-    printf("Destructor called. Allocations left: %zu, Used bytes: %zu\n", m_numAllocations, m_usedBytes);
-    assert(m_numAllocations == 0 && m_usedBytes == 0);
-}
-
-
-// Defensive programming style, essentially in colaescing operations
-void* FreeListAllocator::Allocate(const std::size_t& size, const std::uintptr_t& alignment)
-{
-    FreeBlock* freeBlock = m_freeBlocks;
-    FreeBlock* bestFit = nullptr;
-    std::size_t bestFitTotalSize = 0;
-    std::uintptr_t bestFitAdjustment = 0;
-
-    while (freeBlock != nullptr)
-    {
-        std::uintptr_t adjustment = align_forward_adjustment_with_header<AllocationHeader>(freeBlock, alignment);
-        std::size_t totalSize = size + adjustment + sizeof(AllocationHeader);
-
-        if (freeBlock->size > totalSize && (bestFit == nullptr || freeBlock->size < bestFit->size))
-        {
-            // Defensive pointer operations samples
-            if (freeBlock->next != nullptr)
-                freeBlock->next->prev = freeBlock;
-            if (freeBlock->prev != nullptr)
-                freeBlock->prev->next = freeBlock;
-
-            bestFit = freeBlock;
-            bestFitAdjustment = adjustment;
-            bestFitTotalSize = totalSize;
-        }
-
-        freeBlock = freeBlock->next;
-    }
-
-    if (bestFit == nullptr)
-        throw std::bad_alloc();
-
-    if (bestFit->size <= bestFitTotalSize + sizeof(AllocationHeader))
-    {
-        bestFitTotalSize = bestFit->size;
-
-        if (bestFit->prev != nullptr)
-            bestFit->prev->next = bestFit->next;
-        else
-            m_freeBlocks = bestFit->next;
-
-        if (bestFit->next != nullptr)
-            bestFit->next->prev = bestFit->prev;
-    }
-    else
-    {
-        FreeBlock* newBlock = reinterpret_cast<FreeBlock*>(ptr_add(bestFit, bestFitTotalSize));
-        newBlock->size = bestFit->size - bestFitTotalSize;
-        newBlock->next = bestFit->next;
-        newBlock->prev = bestFit->prev;
-
-        if (bestFit->next != nullptr)           
-            bestFit->next->prev = newBlock;
-        if (bestFit->prev != nullptr)            
-            bestFit->prev->next = newBlock;
-        else
-            m_freeBlocks = newBlock;
-
-        
-    }
-
-    std::uintptr_t alignedAddr = reinterpret_cast<std::uintptr_t>(bestFit) + bestFitAdjustment;
-    AllocationHeader* header = reinterpret_cast<AllocationHeader*>(alignedAddr - sizeof(AllocationHeader));
-    header->adjustment = bestFitAdjustment;
-    header->size = bestFitTotalSize;
-
-    m_usedBytes += bestFitTotalSize;
-    ++m_numAllocations;
-
-    return reinterpret_cast<void*>(alignedAddr);
-}
-
-
-void FreeListAllocator::Free(void* const ptr) noexcept
-{
-    assert(ptr != nullptr);
-
-    AllocationHeader* header = reinterpret_cast<AllocationHeader*>(ptr_sub(ptr, sizeof(AllocationHeader)));
-    std::uintptr_t blockStart = reinterpret_cast<std::uintptr_t>(ptr) - header->adjustment;
-    std::size_t blockSize = header->size;
-    std::uintptr_t blockEnd = blockStart + blockSize;
-
-    FreeBlock* prevFreeBlock = nullptr;
-    FreeBlock* freeBlock = m_freeBlocks;
-
-    while (freeBlock != nullptr && reinterpret_cast<std::uintptr_t>(freeBlock) < blockStart)
-    {
-        prevFreeBlock = freeBlock;
-        freeBlock = freeBlock->next;
-    }
-
-    FreeBlock* newBlock = reinterpret_cast<FreeBlock*>(blockStart);
-    newBlock->size = blockSize;
-    newBlock->next = freeBlock;
-    newBlock->prev = prevFreeBlock;
-
-    if (newBlock->prev != nullptr &&
-        reinterpret_cast<std::uintptr_t>(newBlock->prev) + newBlock->prev->size == reinterpret_cast<std::uintptr_t>(newBlock))
-    {
-        newBlock->prev->size += newBlock->size;
-        newBlock->prev->next = newBlock->next;
-
-        if (newBlock->next)
-        {
-            newBlock->next->prev = newBlock->prev;
-        }
-
-        newBlock = newBlock->prev;
-    }
-
-    if (newBlock->next != nullptr &&
-        reinterpret_cast<std::uintptr_t>(newBlock) + newBlock->size == reinterpret_cast<std::uintptr_t>(newBlock->next))
-    {
-        newBlock->size += newBlock->next->size;
-        newBlock->next = newBlock->next->next;
-
-        if (newBlock->prev)
-        {
-            newBlock->prev->next = newBlock;
-        }
-    }
-
-    if (newBlock->next)
-        newBlock->next->prev = newBlock;
-    if (newBlock->prev)
-        newBlock->prev->next = newBlock;
-    else
-        m_freeBlocks = newBlock;
-
-    std::uint8_t* start = reinterpret_cast<std::uint8_t*>(blockStart + header->adjustment);
-    std::uint8_t* end = reinterpret_cast<std::uint8_t*>(blockStart + blockSize);
-    ZeroedAddresses(start, end);
-
-    --m_numAllocations;
-    m_usedBytes -= blockSize;
-}
-
-
-template<typename T>
-inline std::size_t FreeListAllocator::align_forward_adjustment_with_header(const void* const ptr, const std::size_t& alignment) noexcept      // ptr - could be declared like std::uintptr_t
-{
-    const auto iptr = reinterpret_cast<std::uintptr_t>(ptr);
-    const auto aligned = (iptr + (alignment - 1u)) & ~(alignment - 1u);
-    std::size_t adjustment = aligned - iptr;
-
-    constexpr std::size_t required = sizeof(T);
-
-    if (adjustment < required)
-    {
-        std::size_t neededSpace = required - adjustment;
-        adjustment += alignment * ((neededSpace + alignment - 1u) / alignment);
-    }
-
-    return adjustment;
-}
-
-
-inline void* FreeListAllocator::ptr_add(const void* const p, const std::uintptr_t& amount) noexcept
-{
-    return reinterpret_cast<void*>(reinterpret_cast<std::uintptr_t>(p) + amount);
-}
-
-
-inline void* FreeListAllocator::ptr_sub(const void* const ptr, const std::uintptr_t& sizeHeader) noexcept
-{
-    return reinterpret_cast<void*>(reinterpret_cast<std::uintptr_t>(ptr) - sizeHeader);
-}
-
-
-void FreeListAllocator::ZeroedAddresses(std::uint8_t* ptr_addr, std::uint8_t* zero_addr) noexcept
-{
-    while (ptr_addr < zero_addr)
-        *ptr_addr++ = 0;
-    // iptr_ptr_addr = izero_zero_addr;
-}
\ No newline at end of file
+﻿#pragma once
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <utility>
+#include "StaticAllocator.h"
+#include "BitOperations.h"
+#include "AllocationTrace.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FREELIST_ALLOCATOR_SSE2 1
+#endif
+
+// BestFit scans the whole free list, SegregatedFit keeps free blocks binned
+// by power-of-two size class and picks a block from the first non-empty bin,
+// IndexedBestFit keeps free blocks in a size-ordered red-black tree.
+enum class FreeListFitPolicy
+{
+    BestFit,
+    SegregatedFit,
+    IndexedBestFit
+};
+
+// When memory is cleared:
+// None never, ZeroOnFree clears the freed user bytes in Free (the historical behavior),
+// ZeroOnAllocate clears every allocation, so Allocate returns zeroed memory.
+// Lazy gives the ZeroOnAllocate guarantee but tracks dirty free blocks: clean blocks only
+// have their stale metadata cleared, and ScrubFreeBlocks clears dirty blocks ahead of time.
+enum class FreeListZeroPolicy
+{
+    None,
+    ZeroOnFree,
+    ZeroOnAllocate,
+    Lazy
+};
+
+// Header in front of every allocation:
+// Standard is 16 bytes and accepts any alignment, Compact is 8 bytes and keeps the
+// adjustment in 16 bits, so it accepts alignments up to kMaxCompactAlignment.
+enum class FreeListHeaderPolicy
+{
+    Standard,
+    Compact
+};
+
+
+// Policy selectors for FreeListPolicies:
+// RuntimePolicy leaves the choice to the constructor with Default as its default argument,
+// FixedPolicy fixes it at compile time, so the branches on it fold away.
+template<auto Default>
+struct RuntimePolicy
+{
+    static constexpr bool kFixed = false;
+    static constexpr auto kValue = Default;
+};
+
+template<auto Value>
+struct FixedPolicy
+{
+    static constexpr bool kFixed = true;
+    static constexpr auto kValue = Value;
+};
+
+
+// Lock policy for a single thread, any BasicLockable such as std::mutex serializes the allocator instead
+struct NoLock
+{
+    void lock() noexcept {}
+    void unlock() noexcept {}
+};
+
+
+// Stats policies, the hooks run under the lock
+struct NoStats
+{
+    void OnAllocate(const std::size_t&, const std::size_t&) noexcept {}
+    void OnFree(const std::size_t&) noexcept {}
+    void OnResize(const std::size_t&) noexcept {}
+    void OnFailure() noexcept {}
+};
+
+struct FreeListStats
+{
+    std::size_t allocations = 0;
+    std::size_t frees = 0;
+    std::size_t resizes = 0;
+    std::size_t failures = 0;
+    std::size_t peakUsedBytes = 0;
+
+    void OnAllocate(const std::size_t& count, const std::size_t& usedBytes) noexcept;
+    void OnFree(const std::size_t& count) noexcept;
+    void OnResize(const std::size_t& usedBytes) noexcept;
+    void OnFailure() noexcept;
+};
+
+
+template<typename FitSelector = RuntimePolicy<FreeListFitPolicy::BestFit>,
+    typename HeaderSelector = RuntimePolicy<FreeListHeaderPolicy::Standard>,
+    typename ZeroSelector = RuntimePolicy<FreeListZeroPolicy::ZeroOnFree>,
+    typename LockPolicy = NoLock,
+    typename StatsPolicy = NoStats,
+    typename TracePolicy = NoTrace>
+struct FreeListPolicies
+{
+    using Fit = FitSelector;
+    using Header = HeaderSelector;
+    using Zero = ZeroSelector;
+    using Lock = LockPolicy;
+    using Stats = StatsPolicy;
+    using Trace = TracePolicy;
+};
+
+
+// Not an Abstract class
+// The policies are fixed by FreeListPolicies, FreeListAllocator keeps every choice to the constructor
+template<typename Policies = FreeListPolicies<>>
+class BasicFreeListAllocator final : public StaticAllocator<BasicFreeListAllocator<Policies>>,
+    private Policies::Lock, private Policies::Stats
+{
+    using Base = StaticAllocator<BasicFreeListAllocator<Policies>>;
+    using Lock = typename Policies::Lock;
+    using Stats = typename Policies::Stats;
+    using Trace = typename Policies::Trace;
+
+public:
+    using FitPolicy = FreeListFitPolicy;
+    using ZeroPolicy = FreeListZeroPolicy;
+    using HeaderPolicy = FreeListHeaderPolicy;
+
+    static constexpr std::size_t kMaxCompactAlignment = 32 * 1024;
+    static constexpr std::uint64_t kMaxArenaSize = std::uint64_t(1) << 44;
+
+    BasicFreeListAllocator(const std::size_t sizeBytes, void* start, FitPolicy fitPolicy = Policies::Fit::kValue,
+        ZeroPolicy zeroPolicy = Policies::Zero::kValue, HeaderPolicy headerPolicy = Policies::Header::kValue) noexcept;
+
+    BasicFreeListAllocator(const BasicFreeListAllocator&) = delete;
+    BasicFreeListAllocator& operator=(const BasicFreeListAllocator&) = delete;
+
+    BasicFreeListAllocator(BasicFreeListAllocator&&) noexcept;
+    BasicFreeListAllocator& operator=(BasicFreeListAllocator&&) noexcept;
+
+    ~BasicFreeListAllocator() noexcept override final; // = default;
+
+    virtual void* Allocate(const std::size_t& size, const std::uintptr_t& alignment = sizeof(std::intptr_t)) override final;
+    virtual void Free(void* const ptr) noexcept override final;
+    using Base::Free;
+
+    // Same as Allocate, but returns nullptr instead of throwing when no block fits
+    void* TryAllocate(const std::size_t& size, const std::uintptr_t& alignment = sizeof(std::intptr_t)) noexcept;
+
+    virtual std::size_t GetAllocationSize(const void* const ptr) const noexcept override final;
+
+    // Shrinking splits the tail off as a free block, growing absorbs the next block when it is free
+    virtual bool TryExpandInPlace(void* const ptr, const std::size_t& newSize) noexcept override final;
+
+    // Carves the whole batch from one free block found in a single search, and falls back to
+    // one allocation at a time when no block is large enough
+    virtual void AllocateBatch(const std::size_t& count, const std::size_t& size, const std::uintptr_t& alignment,
+        void** out) override final;
+    virtual void FreeBatch(void* const* ptrs, const std::size_t& count) noexcept override final;
+
+    void ZeroedAddresses(std::uint8_t* ptr_addr, std::uint8_t* zero_addr) noexcept;
+
+    template<typename T>
+    inline std::size_t align_forward_adjustment_with_header(const void* const ptr, const std::size_t& alignment) noexcept;
+    inline void* ptr_add(const void* const p, const std::uintptr_t& amount) noexcept;
+    inline void* ptr_sub(const void* const ptr, const std::uintptr_t& sizeHeader) noexcept;
+
+    std::size_t ScrubFreeBlocks() noexcept;
+
+    // A policy fixed by FreeListPolicies is returned as a constant
+    FitPolicy GetFitPolicy() const noexcept;
+    ZeroPolicy GetZeroPolicy() const noexcept;
+    HeaderPolicy GetHeaderPolicy() const noexcept;
+
+    const Stats& GetStats() const noexcept;
+
+    // Bytes in front of every allocation, and the smallest block an allocation can occupy
+    std::size_t GetHeaderSize() const noexcept;
+    static constexpr std::size_t GetMinBlockSize() noexcept;
+
+private:
+    struct BlockTag;
+    struct FreeBlock;
+    struct AllocationHeader;
+    struct CompactHeader;
+    using BlockFooter = std::uint64_t;
+
+    static constexpr std::size_t kNumSizeClasses = 64;
+
+    // Width of the size field of the block tag, blocks and the arena stay below 16 TiB
+    static constexpr unsigned kSizeBits = 44;
+
+    // BlockTag::flags
+    static constexpr std::uint16_t kBlockFree = 1u << 0;
+    static constexpr std::uint16_t kPrevFree = 1u << 1;
+    static constexpr std::uint16_t kDirty = 1u << 2;        // free block holds more than zeros and its metadata (ZeroPolicy::Lazy)
+    static constexpr std::uint16_t kPrevMinimal = 1u << 3;  // with kPrevFree: the previous block is MinBlockSize bytes and has no footer
+
+    // Spans at least this large are cleared with non-temporal stores, so they do not evict the cache
+    static constexpr std::size_t kStreamingZeroThreshold = 128 * 1024;
+
+    static constexpr std::size_t MinBlockSize() noexcept;
+    static std::size_t RoundBlockSize(const std::size_t& size, const std::uintptr_t& adjustment) noexcept;
+    static std::size_t SizeClassOf(const std::size_t& size) noexcept;
+
+    std::uintptr_t AdjustmentFor(const FreeBlock* block, const std::uintptr_t& alignment) noexcept;
+    std::uintptr_t AdjustmentOf(const void* const ptr) const noexcept;
+    void WriteHeader(const std::uintptr_t& alignedAddr, const std::uintptr_t& adjustment, const std::size_t& blockSize) noexcept;
+    void WriteBlockSize(void* const ptr, const std::uintptr_t& adjustment, const std::size_t& blockSize) noexcept;
+
+    FreeBlock* FindFit(const std::size_t& size, const std::uintptr_t& alignment,
+        std::uintptr_t& adjustment, std::size_t& totalSize) noexcept;
+    void* CarveBlock(FreeBlock* block, const std::uintptr_t& adjustment, std::size_t totalSize) noexcept;
+    void ReleaseBlock(const std::uintptr_t& blockStart, const std::size_t& blockSize) noexcept;
+
+    std::uintptr_t GetArenaEnd() const noexcept;
+    BlockTag* NextPhysical(const FreeBlock* block) noexcept;
+    void WriteFooter(FreeBlock* block) noexcept;
+    void LinkFreeBlock(FreeBlock* block) noexcept;
+    void UnlinkFreeBlock(FreeBlock* block) noexcept;
+
+    void InsertIntoIndex(FreeBlock* block) noexcept;
+    void RemoveFromIndex(FreeBlock* block) noexcept;
+    static void PushToList(FreeBlock*& head, FreeBlock* block) noexcept;
+    static void RemoveFromList(FreeBlock*& head, FreeBlock* block) noexcept;
+
+    FreeBlock* FindSegregatedFit(const std::size_t& size, const std::uintptr_t& alignment,
+        std::uintptr_t& adjustment, std::size_t& totalSize) noexcept;
+    void InsertIntoSizeClass(FreeBlock* block) noexcept;
+    void RemoveFromSizeClass(FreeBlock* block) noexcept;
+
+    FreeBlock* FindIndexedBestFit(const std::size_t& size, const std::uintptr_t& alignment,
+        std::uintptr_t& adjustment, std::size_t& totalSize) noexcept;
+    void InsertIntoTree(FreeBlock* block) noexcept;
+    void RemoveFromTree(FreeBlock* block) noexcept;
+    void RotateLeft(FreeBlock* block) noexcept;
+    void RotateRight(FreeBlock* block) noexcept;
+    void Transplant(FreeBlock* from, FreeBlock* to) noexcept;
+    static bool TreeLess(const FreeBlock* lhs, const FreeBlock* rhs) noexcept;
+    static FreeBlock* TreeMinimum(FreeBlock* block) noexcept;
+    static FreeBlock* TreeSuccessor(FreeBlock* block) noexcept;
+
+    // The lock is mutable state, const members such as GetAllocationSize take it too
+    Lock& GetLock() const noexcept;
+    Stats& GetMutableStats() noexcept;
+
+protected:
+    using Base::m_size;
+    using Base::m_usedBytes;
+    using Base::m_numAllocations;
+    using Base::m_start;
+
+    FreeBlock* m_freeBlocks;                        // unordered list of free blocks, BestFit only
+
+    FitPolicy m_fitPolicy;
+    ZeroPolicy m_zeroPolicy;
+    HeaderPolicy m_headerPolicy;
+    std::uint64_t m_sizeClassMask;                 // bit i is set when m_sizeClasses[i] is not empty
+    FreeBlock* m_sizeClasses[kNumSizeClasses];      // class i holds blocks of [2^i, 2^(i+1)) bytes
+    FreeBlock* m_treeRoot;                          // ordered by (size, address)
+};
+
+using FreeListAllocator = BasicFreeListAllocator<>;
+
+
+void FreeListStats::OnAllocate(const std::size_t& count, const std::size_t& usedBytes) noexcept
+{
+    allocations += count;
+    if (usedBytes > peakUsedBytes)
+        peakUsedBytes = usedBytes;
+}
+
+
+void FreeListStats::OnFree(const std::size_t& count) noexcept
+{
+    frees += count;
+}
+
+
+void FreeListStats::OnResize(const std::size_t& usedBytes) noexcept
+{
+    ++resizes;
+    if (usedBytes > peakUsedBytes)
+        peakUsedBytes = usedBytes;
+}
+
+
+void FreeListStats::OnFailure() noexcept
+{
+    ++failures;
+}
+
+
+// Boundary tag at the start of every block, free or allocated: one 64-bit word holding
+// the size, the CompactHeader adjustment, the flags and the FreeBlock color.
+// FreeBlock and both headers begin with the same word, so when the adjustment
+// equals the header size the header and the tag are the same bytes.
+// A free block also repeats its size in a BlockFooter in its last bytes, which lets
+// the next block find it through kPrevFree. A block of MinBlockSize has no room for one,
+// the next block carries kPrevMinimal instead; that bit is the color of a free block,
+// but the block after a free block is always allocated.
+template<typename Policies>
+struct BasicFreeListAllocator<Policies>::BlockTag {
+    std::uint64_t size : kSizeBits;
+    std::uint64_t : 16;
+    std::uint64_t flags : 4;
+};
+
+
+// index links the block into the structure of the active FitPolicy:
+// list is the unordered free list (BestFit) or the list of its size class (SegregatedFit)
+template<typename Policies>
+struct BasicFreeListAllocator<Policies>::FreeBlock {
+    std::uint64_t size : kSizeBits;
+    std::uint64_t : 16;
+    std::uint64_t flags : 3;
+    std::uint64_t red : 1;      // node color, IndexedBestFit only
+
+    union {
+        struct { FreeBlock* next; FreeBlock* prev; } list;
+        struct { FreeBlock* left; FreeBlock* right; FreeBlock* parent; } tree;
+    } index;
+};
+
+
+template<typename Policies>
+struct BasicFreeListAllocator<Policies>::AllocationHeader {
+    std::uint64_t size : kSizeBits;
+    std::uint64_t : 16;
+    std::uint64_t flags : 4;
+    uintptr_t adjustment;
+};
+
+
+// The adjustment takes the bits the tag leaves unused, so the header is 8 bytes
+template<typename Policies>
+struct BasicFreeListAllocator<Policies>::CompactHeader {
+    std::uint64_t size : kSizeBits;
+    std::uint64_t adjustment : 16;
+    std::uint64_t flags : 4;
+};
+
+
+template<typename Policies>
+constexpr std::size_t BasicFreeListAllocator<Policies>::MinBlockSize() noexcept
+{
+    return (sizeof(FreeBlock) + alignof(FreeBlock) - 1u) & ~(alignof(FreeBlock) - 1u);
+}
+
+
+template<typename Policies>
+constexpr std::size_t BasicFreeListAllocator<Policies>::GetMinBlockSize() noexcept
+{
+    return MinBlockSize();
+}
+
+
+template<typename Policies>
+BasicFreeListAllocator<Policies>::BasicFreeListAllocator(const std::size_t sizeBytes, void* start, FitPolicy fitPolicy, ZeroPolicy zeroPolicy,
+    HeaderPolicy headerPolicy) noexcept
+    :
+    Base(sizeBytes, start), Lock(), Stats(), m_freeBlocks(nullptr),
+    m_fitPolicy(fitPolicy), m_zeroPolicy(zeroPolicy), m_headerPolicy(headerPolicy),
+    m_sizeClassMask(0), m_sizeClasses{}, m_treeRoot(nullptr)
+{
+    static_assert(sizeof(BlockTag) == 8 && sizeof(CompactHeader) == 8, "the block tag and CompactHeader must stay 8 bytes");
+
+    assert(sizeBytes >= MinBlockSize() && sizeBytes < kMaxArenaSize);
+    assert(!Policies::Fit::kFixed || fitPolicy == Policies::Fit::kValue);
+    assert(!Policies::Zero::kFixed || zeroPolicy == Policies::Zero::kValue);
+    assert(!Policies::Header::kFixed || headerPolicy == Policies::Header::kValue);
+    assert(reinterpret_cast<std::uintptr_t>(start) % alignof(FreeBlock) == 0);
+
+    FreeBlock* block = reinterpret_cast<FreeBlock*>(start);
+    block->size = GetArenaEnd() - reinterpret_cast<std::uintptr_t>(start);
+    block->flags = GetZeroPolicy() == ZeroPolicy::Lazy ? kBlockFree | kDirty : kBlockFree;
+    WriteFooter(block);
+    LinkFreeBlock(block);
+}
+
+
+template<typename Policies>
+BasicFreeListAllocator<Policies>::BasicFreeListAllocator(BasicFreeListAllocator&& other) noexcept
+    :
+    Base(std::move(other)), Lock(), Stats(other),
+    m_freeBlocks(other.m_freeBlocks),
+    m_fitPolicy(other.m_fitPolicy),
+    m_zeroPolicy(other.m_zeroPolicy),
+    m_headerPolicy(other.m_headerPolicy),
+    m_sizeClassMask(other.m_sizeClassMask),
+    m_treeRoot(other.m_treeRoot)
+{
+    for (std::size_t i = 0; i < kNumSizeClasses; ++i)
+    {
+        m_sizeClasses[i] = other.m_sizeClasses[i];
+        other.m_sizeClasses[i] = nullptr;
+    }
+
+    other.m_freeBlocks = nullptr;
+    other.m_sizeClassMask = 0;
+    other.m_treeRoot = nullptr;
+}
+
+
+template<typename Policies>
+BasicFreeListAllocator<Policies>& BasicFreeListAllocator<Policies>::operator=(BasicFreeListAllocator&& rhs) noexcept
+{
+    if (this != &rhs) {
+        Base::operator=(std::move(rhs));
+        Stats::operator=(rhs);
+        m_freeBlocks = rhs.m_freeBlocks;
+        m_fitPolicy = rhs.m_fitPolicy;
+        m_zeroPolicy = rhs.m_zeroPolicy;
+        m_headerPolicy = rhs.m_headerPolicy;
+        m_sizeClassMask = rhs.m_sizeClassMask;
+        m_treeRoot = rhs.m_treeRoot;
+
+        for (std::size_t i = 0; i < kNumSizeClasses; ++i)
+        {
+            m_sizeClasses[i] = rhs.m_sizeClasses[i];
+            rhs.m_sizeClasses[i] = nullptr;
+        }
+
+        rhs.m_freeBlocks = nullptr;
+        rhs.m_sizeClassMask = 0;
+        rhs.m_treeRoot = nullptr;
+    }
+
+    return *this;
+}
+
+
+template<typename Policies>
+BasicFreeListAllocator<Policies>::~BasicFreeListAllocator() noexcept
+{
+    Trace::Record({ TraceOp::Destroy, m_usedBytes, 0, m_start, this, FREELIST_TRACE_CALLER() });
+    assert(m_numAllocations == 0 && m_usedBytes == 0);
+}
+
+
+template<typename Policies>
+void* BasicFreeListAllocator<Policies>::Allocate(const std::size_t& size, const std::uintptr_t& alignment)
+{
+    void* ptr = TryAllocate(size, alignment);
+
+    if (ptr == nullptr)
+        throw std::bad_alloc();
+
+    return ptr;
+}
+
+
+template<typename Policies>
+void* BasicFreeListAllocator<Policies>::TryAllocate(const std::size_t& size, const std::uintptr_t& alignment) noexcept
+{
+    std::size_t totalSize = 0;
+    std::uintptr_t adjustment = 0;
+
+    std::lock_guard<Lock> guard(GetLock());
+
+    if (GetHeaderPolicy() == HeaderPolicy::Compact && alignment > kMaxCompactAlignment)
+    {
+        GetMutableStats().OnFailure();
+        return nullptr;
+    }
+
+    // No arena is that large, and RoundBlockSize would wrap for sizes near SIZE_MAX
+    if (size >= kMaxArenaSize || alignment >= kMaxArenaSize)
+    {
+        GetMutableStats().OnFailure();
+        return nullptr;
+    }
+
+    FreeBlock* block = FindFit(size, alignment, adjustment, totalSize);
+    if (block == nullptr)
+    {
+        GetMutableStats().OnFailure();
+        return nullptr;
+    }
+
+    void* ptr = CarveBlock(block, adjustment, totalSize);
+    GetMutableStats().OnAllocate(1, m_usedBytes);
+    Trace::Record({ TraceOp::Allocate, size, alignment, ptr, this, FREELIST_TRACE_CALLER() });
+
+    return ptr;
+}
+
+
+// Defensive programming style, essentially in colaescing operations
+template<typename Policies>
+typename BasicFreeListAllocator<Policies>::FreeBlock* BasicFreeListAllocator<Policies>::FindFit(const std::size_t& size, const std::uintptr_t& alignment,
+    std::uintptr_t& bestFitAdjustment, std::size_t& bestFitTotalSize) noexcept
+{
+    FreeBlock* bestFit = nullptr;
+
+    if (GetFitPolicy() == FitPolicy::SegregatedFit)
+    {
+        bestFit = FindSegregatedFit(size, alignment, bestFitAdjustment, bestFitTotalSize);
+    }
+    else if (GetFitPolicy() == FitPolicy::IndexedBestFit)
+    {
+        bestFit = FindIndexedBestFit(size, alignment, bestFitAdjustment, bestFitTotalSize);
+    }
+    else
+    {
+        FreeBlock* freeBlock = m_freeBlocks;
+
+        while (freeBlock != nullptr)
+        {
+            std::uintptr_t adjustment = AdjustmentFor(freeBlock, alignment);
+            std::size_t totalSize = RoundBlockSize(size, adjustment);
+
+            if (static_cast<std::size_t>(freeBlock->size) >= totalSize && (bestFit == nullptr || freeBlock->size < bestFit->size))
+            {
+                // Defensive pointer operations samples
+                if (freeBlock->index.list.next != nullptr)
+                    freeBlock->index.list.next->index.list.prev = freeBlock;
+                if (freeBlock->index.list.prev != nullptr)
+                    freeBlock->index.list.prev->index.list.next = freeBlock;
+
+                bestFit = freeBlock;
+                bestFitAdjustment = adjustment;
+                bestFitTotalSize = totalSize;
+            }
+
+            freeBlock = freeBlock->index.list.next;
+        }
+    }
+
+    return bestFit;
+}
+
+
+// Takes bestFit out of the index, splits off the remainder and writes the header
+template<typename Policies>
+void* BasicFreeListAllocator<Policies>::CarveBlock(FreeBlock* bestFit, const std::uintptr_t& bestFitAdjustment,
+    std::size_t bestFitTotalSize) noexcept
+{
+    UnlinkFreeBlock(bestFit);
+
+    const bool dirty = (bestFit->flags & kDirty) != 0;
+
+    // The remainder must be able to hold its own FreeBlock, otherwise it is handed out with the allocation
+    if (static_cast<std::size_t>(bestFit->size) < bestFitTotalSize + MinBlockSize())
+    {
+        bestFitTotalSize = bestFit->size;
+
+        BlockTag* next = NextPhysical(bestFit);
+        if (next != nullptr)
+            next->flags &= ~(kPrevFree | kPrevMinimal);
+    }
+    else
+    {
+        // Free blocks are never adjacent, so the next physical block keeps its kPrevFree
+        FreeBlock* newBlock = reinterpret_cast<FreeBlock*>(ptr_add(bestFit, bestFitTotalSize));
+        newBlock->size = bestFit->size - bestFitTotalSize;
+        newBlock->flags = dirty ? kBlockFree | kDirty : kBlockFree;
+        WriteFooter(newBlock);
+        LinkFreeBlock(newBlock);
+    }
+
+    std::uintptr_t alignedAddr = reinterpret_cast<std::uintptr_t>(bestFit) + bestFitAdjustment;
+    WriteHeader(alignedAddr, bestFitAdjustment, bestFitTotalSize);
+
+    if (GetZeroPolicy() == ZeroPolicy::ZeroOnAllocate || GetZeroPolicy() == ZeroPolicy::Lazy)
+    {
+        std::uint8_t* start = reinterpret_cast<std::uint8_t*>(alignedAddr);
+        std::uint8_t* end = reinterpret_cast<std::uint8_t*>(reinterpret_cast<std::uintptr_t>(bestFit) + bestFitTotalSize);
+
+        if (GetZeroPolicy() == ZeroPolicy::ZeroOnAllocate || dirty)
+        {
+            ZeroedAddresses(start, end);
+        }
+        else
+        {
+            // A clean block is zero except for the FreeBlock it started with and its footer
+            std::uint8_t* metadataEnd = reinterpret_cast<std::uint8_t*>(ptr_add(bestFit, sizeof(FreeBlock)));
+            ZeroedAddresses(start, metadataEnd < end ? metadataEnd : end);
+
+            std::uint8_t* footer = end - sizeof(BlockFooter);
+            ZeroedAddresses(footer > start ? footer : start, end);
+        }
+    }
+
+    m_usedBytes += bestFitTotalSize;
+    ++m_numAllocations;
+
+    return reinterpret_cast<void*>(alignedAddr);
+}
+
+
+template<typename Policies>
+void BasicFreeListAllocator<Policies>::Free(void* const ptr) noexcept
+{
+    assert(ptr != nullptr);
+
+    std::lock_guard<Lock> guard(GetLock());
+
+    const std::uintptr_t blockStart = reinterpret_cast<std::uintptr_t>(ptr) - AdjustmentOf(ptr);
+    const std::size_t blockSize = reinterpret_cast<const BlockTag*>(blockStart)->size;
+
+    std::uintptr_t blockEnd = blockStart + blockSize;
+
+    // Zero the user bytes before the FreeBlock is written, the block metadata may overlap them
+    if (GetZeroPolicy() == ZeroPolicy::ZeroOnFree)
+    {
+        std::uint8_t* start = reinterpret_cast<std::uint8_t*>(ptr);
+        std::uint8_t* end = reinterpret_cast<std::uint8_t*>(blockEnd);
+        ZeroedAddresses(start, end);
+    }
+
+    ReleaseBlock(blockStart, blockSize);
+
+    --m_numAllocations;
+    m_usedBytes -= blockSize;
+    GetMutableStats().OnFree(1);
+    Trace::Record({ TraceOp::Free, blockSize, 0, ptr, this, FREELIST_TRACE_CALLER() });
+}
+
+
+template<typename Policies>
+void BasicFreeListAllocator<Policies>::AllocateBatch(const std::size_t& count, const std::size_t& size, const std::uintptr_t& alignment,
+    void** out)
+{
+    if (count == 0)
+        return;
+
+    if (GetHeaderPolicy() == HeaderPolicy::Compact && alignment > kMaxCompactAlignment)
+        throw std::bad_alloc();
+
+    // Every block but the first is stride bytes with the header right at its start, a stride that is
+    // a multiple of the alignment keeps all of them aligned once the first one is
+    const std::size_t headerSize = GetHeaderSize();
+    const std::size_t strideAlignment = alignment > alignof(FreeBlock) ? alignment : alignof(FreeBlock);
+
+    if (size > kMaxArenaSize)
+        throw std::bad_alloc();
+
+    std::size_t stride = size + headerSize > MinBlockSize() ? size + headerSize : MinBlockSize();
+    stride = (stride + strideAlignment - 1u) & ~(strideAlignment - 1u);
+
+    if (count > kMaxArenaSize / stride)
+        throw std::bad_alloc();
+
+    std::unique_lock<Lock> guard(GetLock());
+
+    // The search adds the adjustment of the first block, which also covers its alignment padding
+    std::uintptr_t adjustment = 0;
+    std::size_t totalSize = 0;
+    FreeBlock* block = FindFit(count * stride - headerSize, alignment, adjustment, totalSize);
+
+    // The fallback allocates through Allocate, which takes the lock itself
+    if (block == nullptr)
+    {
+        guard.unlock();
+        Base::AllocateBatch(count, size, alignment, out);
+        return;
+    }
+
+    // One allocation spanning the batch, cut into count blocks afterwards
+    const std::uintptr_t regionStart = reinterpret_cast<std::uintptr_t>(block);
+    out[0] = CarveBlock(block, adjustment, totalSize);
+
+    const std::uintptr_t regionEnd = regionStart + reinterpret_cast<const BlockTag*>(regionStart)->size;
+    const std::uintptr_t slotsStart = reinterpret_cast<std::uintptr_t>(out[0]) - headerSize;     // block i > 0 starts at slotsStart + i * stride
+
+    WriteBlockSize(out[0], adjustment, (count > 1u ? slotsStart + stride : regionEnd) - regionStart);
+
+    for (std::size_t i = 1; i < count; ++i)
+    {
+        const std::uintptr_t blockStart = slotsStart + i * stride;
+        const std::uintptr_t blockEnd = i + 1u < count ? blockStart + stride : regionEnd;
+
+        WriteHeader(blockStart + headerSize, headerSize, blockEnd - blockStart);
+        out[i] = reinterpret_cast<void*>(blockStart + headerSize);
+    }
+
+    m_numAllocations += count - 1u;
+    GetMutableStats().OnAllocate(count, m_usedBytes);
+
+    for (std::size_t i = 0; i < count; ++i)
+        Trace::Record({ TraceOp::Allocate, size, alignment, out[i], this, FREELIST_TRACE_CALLER() });
+}
+
+
+// Runs of physically adjacent blocks, as a batch from AllocateBatch freed in order, are released
+// as one block, so they cost a single coalescing step and index update
+template<typename Policies>
+void BasicFreeListAllocator<Policies>::FreeBatch(void* const* ptrs, const std::size_t& count) noexcept
+{
+    std::lock_guard<Lock> guard(GetLock());
+
+    std::size_t i = 0;
+
+    while (i < count)
+    {
+        assert(ptrs[i] != nullptr);
+
+        const std::uintptr_t runStart = reinterpret_cast<std::uintptr_t>(ptrs[i]) - AdjustmentOf(ptrs[i]);
+        std::uintptr_t runEnd = runStart + reinterpret_cast<const BlockTag*>(runStart)->size;
+        void* const firstPtr = ptrs[i];
+
+        Trace::Record({ TraceOp::Free, runEnd - runStart, 0, firstPtr, this, FREELIST_TRACE_CALLER() });
+
+        for (++i; i < count; ++i)
+        {
+            assert(ptrs[i] != nullptr);
+
+            const std::uintptr_t blockStart = reinterpret_cast<std::uintptr_t>(ptrs[i]) - AdjustmentOf(ptrs[i]);
+            if (blockStart != runEnd)
+                break;
+
+            const std::size_t blockSize = reinterpret_cast<const BlockTag*>(blockStart)->size;
+            Trace::Record({ TraceOp::Free, blockSize, 0, ptrs[i], this, FREELIST_TRACE_CALLER() });
+
+            runEnd += blockSize;
+            --m_numAllocations;
+        }
+
+        // Headers inside the run are cleared with the user bytes
+        if (GetZeroPolicy() == ZeroPolicy::ZeroOnFree)
+            ZeroedAddresses(reinterpret_cast<std::uint8_t*>(firstPtr), reinterpret_cast<std::uint8_t*>(runEnd));
+
+        ReleaseBlock(runStart, runEnd - runStart);
+
+        --m_numAllocations;
+        m_usedBytes -= runEnd - runStart;
+    }
+
+    GetMutableStats().OnFree(count);
+}
+
+
+// Turns [blockStart, blockStart + blockSize) into a free block merged with its free neighbours.
+// Physical neighbours are found through the boundary tags, no list walk is needed
+template<typename Policies>
+void BasicFreeListAllocator<Policies>::ReleaseBlock(const std::uintptr_t& blockStart, const std::size_t& blockSize) noexcept
+{
+    FreeBlock* newBlock = reinterpret_cast<FreeBlock*>(blockStart);
+    const std::uint16_t tagFlags = reinterpret_cast<const BlockTag*>(blockStart)->flags;
+    newBlock->size = blockSize;
+
+    if ((tagFlags & kPrevFree) != 0)
+    {
+        const std::size_t prevSize = (tagFlags & kPrevMinimal) != 0 ?
+            MinBlockSize() : *reinterpret_cast<BlockFooter*>(ptr_sub(newBlock, sizeof(BlockFooter)));
+        FreeBlock* prevBlock = reinterpret_cast<FreeBlock*>(ptr_sub(newBlock, prevSize));
+        assert((prevBlock->flags & kBlockFree) != 0 && prevBlock->size == prevSize);
+
+        UnlinkFreeBlock(prevBlock);
+        prevBlock->size += newBlock->size;
+        newBlock = prevBlock;
+    }
+
+    BlockTag* next = NextPhysical(newBlock);
+    if (next != nullptr && (next->flags & kBlockFree) != 0)
+    {
+        FreeBlock* nextBlock = reinterpret_cast<FreeBlock*>(next);
+
+        UnlinkFreeBlock(nextBlock);
+        newBlock->size += nextBlock->size;
+    }
+
+    newBlock->flags = GetZeroPolicy() == ZeroPolicy::Lazy ? kBlockFree | kDirty : kBlockFree;
+    WriteFooter(newBlock);
+    LinkFreeBlock(newBlock);
+
+    next = NextPhysical(newBlock);
+    if (next != nullptr)
+        next->flags |= kPrevFree;
+}
+
+
+template<typename Policies>
+std::size_t BasicFreeListAllocator<Policies>::GetAllocationSize(const void* const ptr) const noexcept
+{
+    assert(ptr != nullptr);
+
+    // A neighbour's Free updates the flags next to the header
+    std::lock_guard<Lock> guard(GetLock());
+
+    const std::uintptr_t blockStart = reinterpret_cast<std::uintptr_t>(ptr) - AdjustmentOf(ptr);
+    return blockStart + reinterpret_cast<const BlockTag*>(blockStart)->size - reinterpret_cast<std::uintptr_t>(ptr);
+}
+
+
+template<typename Policies>
+bool BasicFreeListAllocator<Policies>::TryExpandInPlace(void* const ptr, const std::size_t& newSize) noexcept
+{
+    assert(ptr != nullptr);
+
+    if (newSize >= kMaxArenaSize)
+        return false;
+
+    std::lock_guard<Lock> guard(GetLock());
+
+    const std::uintptr_t adjustment = AdjustmentOf(ptr);
+    FreeBlock* block = reinterpret_cast<FreeBlock*>(ptr_sub(ptr, adjustment));
+
+    const std::size_t blockSize = block->size;
+    const std::size_t required = RoundBlockSize(newSize, adjustment);
+
+    if (required <= blockSize)
+    {
+        // A tail too small for a FreeBlock stays with the allocation
+        if (blockSize - required < MinBlockSize())
+            return true;
+
+        std::uint8_t* tailStart = reinterpret_cast<std::uint8_t*>(ptr_add(block, required));
+        if (GetZeroPolicy() == ZeroPolicy::ZeroOnFree)
+            ZeroedAddresses(tailStart, reinterpret_cast<std::uint8_t*>(ptr_add(block, blockSize)));
+
+        WriteBlockSize(ptr, adjustment, required);
+
+        FreeBlock* tail = reinterpret_cast<FreeBlock*>(tailStart);
+        tail->size = blockSize - required;
+
+        BlockTag* next = NextPhysical(tail);
+        if (next != nullptr && (next->flags & kBlockFree) != 0)
+        {
+            FreeBlock* nextBlock = reinterpret_cast<FreeBlock*>(next);
+
+            UnlinkFreeBlock(nextBlock);
+            tail->size += nextBlock->size;
+        }
+
+        tail->flags = GetZeroPolicy() == ZeroPolicy::Lazy ? kBlockFree | kDirty : kBlockFree;
+        WriteFooter(tail);
+        LinkFreeBlock(tail);
+
+        next = NextPhysical(tail);
+        if (next != nullptr)
+            next->flags |= kPrevFree;
+
+        m_usedBytes -= blockSize - required;
+        GetMutableStats().OnResize(m_usedBytes);
+        return true;
+    }
+
+    BlockTag* next = NextPhysical(block);
+    if (next == nullptr || (next->flags & kBlockFree) == 0 || blockSize + next->size < required)
+        return false;
+
+    FreeBlock* nextBlock = reinterpret_cast<FreeBlock*>(next);
+    const std::size_t nextSize = nextBlock->size;
+    const bool dirty = (nextBlock->flags & kDirty) != 0;
+
+    UnlinkFreeBlock(nextBlock);
+
+    // Same split rule as TryAllocate, the remainder keeps the dirty flag of the absorbed block
+    std::size_t newBlockSize = blockSize + nextSize;
+    if (newBlockSize - required >= MinBlockSize())
+    {
+        FreeBlock* remainder = reinterpret_cast<FreeBlock*>(ptr_add(block, required));
+        remainder->size = newBlockSize - required;
+        remainder->flags = dirty ? kBlockFree | kDirty : kBlockFree;
+        WriteFooter(remainder);
+        LinkFreeBlock(remainder);
+
+        newBlockSize = required;
+    }
+
+    WriteBlockSize(ptr, adjustment, newBlockSize);
+
+    if (newBlockSize == blockSize + nextSize)
+    {
+        BlockTag* after = NextPhysical(block);
+        if (after != nullptr)
+            after->flags &= ~(kPrevFree | kPrevMinimal);
+    }
+
+    if (GetZeroPolicy() == ZeroPolicy::ZeroOnAllocate || GetZeroPolicy() == ZeroPolicy::Lazy)
+    {
+        std::uint8_t* start = reinterpret_cast<std::uint8_t*>(nextBlock);
+        std::uint8_t* end = reinterpret_cast<std::uint8_t*>(ptr_add(block, newBlockSize));
+
+        if (GetZeroPolicy() == ZeroPolicy::ZeroOnAllocate || dirty)
+        {
+            ZeroedAddresses(start, end);
+        }
+        else
+        {
+            // Only the FreeBlock and the footer of a clean block are not zero
+            std::uint8_t* metadataEnd = start + sizeof(FreeBlock);
+            ZeroedAddresses(start, metadataEnd < end ? metadataEnd : end);
+
+            std::uint8_t* footer = start + nextSize - sizeof(BlockFooter);
+            ZeroedAddresses(footer > start ? footer : start, end);
+        }
+    }
+
+    m_usedBytes += newBlockSize - blockSize;
+    GetMutableStats().OnResize(m_usedBytes);
+    return true;
+}
+
+
+template<typename Policies>
+template<typename T>
+inline std::size_t BasicFreeListAllocator<Policies>::align_forward_adjustment_with_header(const void* const ptr, const std::size_t& alignment) noexcept      // ptr - could be declared like std::uintptr_t
+{
+    const auto iptr = reinterpret_cast<std::uintptr_t>(ptr);
+    const auto aligned = (iptr + (alignment - 1u)) & ~(alignment - 1u);
+    std::size_t adjustment = aligned - iptr;
+
+    constexpr std::size_t required = sizeof(T);
+
+    if (adjustment < required)
+    {
+        std::size_t neededSpace = required - adjustment;
+        adjustment += alignment * ((neededSpace + alignment - 1u) / alignment);
+    }
+
+    return adjustment;
+}
+
+
+template<typename Policies>
+inline void* BasicFreeListAllocator<Policies>::ptr_add(const void* const p, const std::uintptr_t& amount) noexcept
+{
+    return reinterpret_cast<void*>(reinterpret_cast<std::uintptr_t>(p) + amount);
+}
+
+
+template<typename Policies>
+inline void* BasicFreeListAllocator<Policies>::ptr_sub(const void* const ptr, const std::uintptr_t& sizeHeader) noexcept
+{
+    return reinterpret_cast<void*>(reinterpret_cast<std::uintptr_t>(ptr) - sizeHeader);
+}
+
+
+template<typename Policies>
+void BasicFreeListAllocator<Policies>::ZeroedAddresses(std::uint8_t* ptr_addr, std::uint8_t* zero_addr) noexcept
+{
+    if (ptr_addr >= zero_addr)
+        return;
+
+    std::size_t length = static_cast<std::size_t>(zero_addr - ptr_addr);
+
+#if defined(FREELIST_ALLOCATOR_SSE2)
+    if (length >= kStreamingZeroThreshold)
+    {
+        std::uint8_t* aligned = reinterpret_cast<std::uint8_t*>((reinterpret_cast<std::uintptr_t>(ptr_addr) + 15u) & ~std::uintptr_t(15u));
+        std::memset(ptr_addr, 0, static_cast<std::size_t>(aligned - ptr_addr));
+
+        const __m128i zero = _mm_setzero_si128();
+        __m128i* dst = reinterpret_cast<__m128i*>(aligned);
+        __m128i* const dstEnd = reinterpret_cast<__m128i*>(aligned + ((zero_addr - aligned) & ~std::ptrdiff_t(63)));
+
+        for (; dst < dstEnd; dst += 4)
+        {
+            _mm_stream_si128(dst + 0, zero);
+            _mm_stream_si128(dst + 1, zero);
+            _mm_stream_si128(dst + 2, zero);
+            _mm_stream_si128(dst + 3, zero);
+        }
+
+        // Streaming stores are weakly ordered, fence them before the block is handed out again
+        _mm_sfence();
+
+        ptr_addr = reinterpret_cast<std::uint8_t*>(dstEnd);
+        length = static_cast<std::size_t>(zero_addr - ptr_addr);
+    }
+#endif
+
+    std::memset(ptr_addr, 0, length);
+}
+
+
+// Clears every dirty free block ahead of time, so later allocations skip the zeroing.
+// Returns the number of bytes cleared.
+template<typename Policies>
+std::size_t BasicFreeListAllocator<Policies>::ScrubFreeBlocks() noexcept
+{
+    std::lock_guard<Lock> guard(GetLock());
+
+    std::size_t scrubbed = 0;
+
+    // Every block starts with its tag, so the arena can be walked in address order whatever the FitPolicy
+    for (std::uintptr_t address = reinterpret_cast<std::uintptr_t>(m_start); address < GetArenaEnd(); )
+    {
+        FreeBlock* block = reinterpret_cast<FreeBlock*>(address);
+        address += block->size;
+
+        if ((block->flags & (kBlockFree | kDirty)) != (kBlockFree | kDirty))
+            continue;
+
+        // A block of MinBlockSize is all metadata
+        std::uint8_t* start = reinterpret_cast<std::uint8_t*>(ptr_add(block, sizeof(FreeBlock)));
+        std::uint8_t* end = reinterpret_cast<std::uint8_t*>(ptr_add(block, block->size - sizeof(BlockFooter)));
+        if (start < end)
+        {
+            ZeroedAddresses(start, end);
+            scrubbed += static_cast<std::size_t>(end - start);
+        }
+
+        block->flags &= ~kDirty;
+    }
+
+    return scrubbed;
+}
+
+
+template<typename Policies>
+typename BasicFreeListAllocator<Policies>::FitPolicy BasicFreeListAllocator<Policies>::GetFitPolicy() const noexcept
+{
+    if constexpr (Policies::Fit::kFixed)
+        return Policies::Fit::kValue;
+    else
+        return m_fitPolicy;
+}
+
+
+template<typename Policies>
+typename BasicFreeListAllocator<Policies>::ZeroPolicy BasicFreeListAllocator<Policies>::GetZeroPolicy() const noexcept
+{
+    if constexpr (Policies::Zero::kFixed)
+        return Policies::Zero::kValue;
+    else
+        return m_zeroPolicy;
+}
+
+
+template<typename Policies>
+typename BasicFreeListAllocator<Policies>::HeaderPolicy BasicFreeListAllocator<Policies>::GetHeaderPolicy() const noexcept
+{
+    if constexpr (Policies::Header::kFixed)
+        return Policies::Header::kValue;
+    else
+        return m_headerPolicy;
+}
+
+
+template<typename Policies>
+const typename BasicFreeListAllocator<Policies>::Stats& BasicFreeListAllocator<Policies>::GetStats() const noexcept
+{
+    return *this;
+}
+
+
+template<typename Policies>
+typename BasicFreeListAllocator<Policies>::Stats& BasicFreeListAllocator<Policies>::GetMutableStats() noexcept
+{
+    return *this;
+}
+
+
+template<typename Policies>
+typename BasicFreeListAllocator<Policies>::Lock& BasicFreeListAllocator<Policies>::GetLock() const noexcept
+{
+    return const_cast<BasicFreeListAllocator&>(*this);
+}
+
+
+template<typename Policies>
+std::size_t BasicFreeListAllocator<Policies>::GetHeaderSize() const noexcept
+{
+    return GetHeaderPolicy() == HeaderPolicy::Compact ? sizeof(CompactHeader) : sizeof(AllocationHeader);
+}
+
+
+// Block size for an allocation: the adjustment already holds the header,
+// keeps room for a FreeBlock once the block is freed and keeps the next block start aligned for FreeBlock
+template<typename Policies>
+std::size_t BasicFreeListAllocator<Policies>::RoundBlockSize(const std::size_t& size, const std::uintptr_t& adjustment) noexcept
+{
+    std::size_t totalSize = size + adjustment;
+
+    if (totalSize < MinBlockSize())
+        totalSize = MinBlockSize();
+
+    return (totalSize + alignof(FreeBlock) - 1u) & ~(alignof(FreeBlock) - 1u);
+}
+
+
+template<typename Policies>
+std::uintptr_t BasicFreeListAllocator<Policies>::AdjustmentFor(const FreeBlock* block, const std::uintptr_t& alignment) noexcept
+{
+    if (GetHeaderPolicy() == HeaderPolicy::Compact)
+        return align_forward_adjustment_with_header<CompactHeader>(block, alignment);
+
+    return align_forward_adjustment_with_header<AllocationHeader>(block, alignment);
+}
+
+
+// The arena is trimmed to whole FreeBlock alignment units, so every block and footer stays aligned
+template<typename Policies>
+std::uintptr_t BasicFreeListAllocator<Policies>::AdjustmentOf(const void* const ptr) const noexcept
+{
+    const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(ptr);
+
+    if (GetHeaderPolicy() == HeaderPolicy::Compact)
+        return reinterpret_cast<const CompactHeader*>(address - sizeof(CompactHeader))->adjustment;
+
+    return reinterpret_cast<const AllocationHeader*>(address - sizeof(AllocationHeader))->adjustment;
+}
+
+
+// The previous physical block of a new allocation is always allocated, so the tag flags are cleared
+template<typename Policies>
+void BasicFreeListAllocator<Policies>::WriteHeader(const std::uintptr_t& alignedAddr, const std::uintptr_t& adjustment,
+    const std::size_t& blockSize) noexcept
+{
+    if (GetHeaderPolicy() == HeaderPolicy::Compact)
+    {
+        CompactHeader* header = reinterpret_cast<CompactHeader*>(alignedAddr - sizeof(CompactHeader));
+        header->adjustment = static_cast<std::uint16_t>(adjustment);
+        header->size = blockSize;
+        header->flags = 0;
+    }
+    else
+    {
+        AllocationHeader* header = reinterpret_cast<AllocationHeader*>(alignedAddr - sizeof(AllocationHeader));
+        header->adjustment = adjustment;
+        header->size = blockSize;
+        header->flags = 0;
+    }
+
+    BlockTag* tag = reinterpret_cast<BlockTag*>(alignedAddr - adjustment);
+    tag->size = blockSize;
+    tag->flags = 0;
+}
+
+
+// The header and the tag at the block start both record the size, they may be different bytes
+template<typename Policies>
+void BasicFreeListAllocator<Policies>::WriteBlockSize(void* const ptr, const std::uintptr_t& adjustment, const std::size_t& blockSize) noexcept
+{
+    if (GetHeaderPolicy() == HeaderPolicy::Compact)
+        reinterpret_cast<CompactHeader*>(ptr_sub(ptr, sizeof(CompactHeader)))->size = blockSize;
+    else
+        reinterpret_cast<AllocationHeader*>(ptr_sub(ptr, sizeof(AllocationHeader)))->size = blockSize;
+
+    reinterpret_cast<BlockTag*>(ptr_sub(ptr, adjustment))->size = blockSize;
+}
+
+
+template<typename Policies>
+std::uintptr_t BasicFreeListAllocator<Policies>::GetArenaEnd() const noexcept
+{
+    return reinterpret_cast<std::uintptr_t>(m_start) + (m_size & ~(alignof(FreeBlock) - 1u));
+}
+
+
+template<typename Policies>
+typename BasicFreeListAllocator<Policies>::BlockTag* BasicFreeListAllocator<Policies>::NextPhysical(const FreeBlock* block) noexcept
+{
+    const std::uintptr_t next = reinterpret_cast<std::uintptr_t>(block) + block->size;
+    return next < GetArenaEnd() ? reinterpret_cast<BlockTag*>(next) : nullptr;
+}
+
+
+// Called once the free block has its final size, after merging, so the next block is allocated
+template<typename Policies>
+void BasicFreeListAllocator<Policies>::WriteFooter(FreeBlock* block) noexcept
+{
+    const bool minimal = block->size == MinBlockSize();
+    if (!minimal)
+        *reinterpret_cast<BlockFooter*>(ptr_add(block, block->size - sizeof(BlockFooter))) = block->size;
+
+    BlockTag* next = NextPhysical(block);
+    assert(next == nullptr || (next->flags & kBlockFree) == 0);
+
+    if (next != nullptr)
+        next->flags = minimal ? next->flags | kPrevMinimal : next->flags & ~kPrevMinimal;
+}
+
+
+template<typename Policies>
+void BasicFreeListAllocator<Policies>::LinkFreeBlock(FreeBlock* block) noexcept
+{
+    InsertIntoIndex(block);
+}
+
+
+template<typename Policies>
+void BasicFreeListAllocator<Policies>::UnlinkFreeBlock(FreeBlock* block) noexcept
+{
+    RemoveFromIndex(block);
+}
+
+
+// Lists are unordered, blocks are pushed at the head
+template<typename Policies>
+void BasicFreeListAllocator<Policies>::PushToList(FreeBlock*& head, FreeBlock* block) noexcept
+{
+    block->index.list.prev = nullptr;
+    block->index.list.next = head;
+
+    if (head != nullptr)
+        head->index.list.prev = block;
+
+    head = block;
+}
+
+
+template<typename Policies>
+void BasicFreeListAllocator<Policies>::RemoveFromList(FreeBlock*& head, FreeBlock* block) noexcept
+{
+    if (block->index.list.prev != nullptr)
+        block->index.list.prev->index.list.next = block->index.list.next;
+    else
+        head = block->index.list.next;
+
+    if (block->index.list.next != nullptr)
+        block->index.list.next->index.list.prev = block->index.list.prev;
+}
+
+
+template<typename Policies>
+std::size_t BasicFreeListAllocator<Policies>::SizeClassOf(const std::size_t& size) noexcept
+{
+    return FindHighestSetBit(size);
+}
+
+
+template<typename Policies>
+void BasicFreeListAllocator<Policies>::InsertIntoIndex(FreeBlock* block) noexcept
+{
+    if (GetFitPolicy() == FitPolicy::SegregatedFit)
+        InsertIntoSizeClass(block);
+    else if (GetFitPolicy() == FitPolicy::IndexedBestFit)
+        InsertIntoTree(block);
+    else
+        PushToList(m_freeBlocks, block);
+}
+
+
+template<typename Policies>
+void BasicFreeListAllocator<Policies>::RemoveFromIndex(FreeBlock* block) noexcept
+{
+    if (GetFitPolicy() == FitPolicy::SegregatedFit)
+        RemoveFromSizeClass(block);
+    else if (GetFitPolicy() == FitPolicy::IndexedBestFit)
+        RemoveFromTree(block);
+    else
+        RemoveFromList(m_freeBlocks, block);
+}
+
+
+template<typename Policies>
+typename BasicFreeListAllocator<Policies>::FreeBlock* BasicFreeListAllocator<Policies>::FindSegregatedFit(const std::size_t& size, const std::uintptr_t& alignment,
+    std::uintptr_t& adjustment, std::size_t& totalSize) noexcept
+{
+    // The adjustment never reaches the header size + alignment, so a block of
+    // worstCase bytes fits the request whatever its start address is
+    const std::size_t worstCase = RoundBlockSize(size, GetHeaderSize() + alignment - 1u);
+    const std::size_t floorClass = SizeClassOf(worstCase);
+    const std::size_t ceilClass = (worstCase & (worstCase - 1u)) == 0 ? floorClass : floorClass + 1u;
+
+    // Fast path: every block of a class >= ceilClass fits, take the head of the first non-empty one
+    if (ceilClass < kNumSizeClasses)
+    {
+        const std::uint64_t candidates = m_sizeClassMask & (~std::uint64_t(0) << ceilClass);
+
+        if (candidates != 0)
+        {
+            FreeBlock* block = m_sizeClasses[FindLowestSetBit(candidates)];
+            adjustment = AdjustmentFor(block, alignment);
+            totalSize = RoundBlockSize(size, adjustment);
+            return block;
+        }
+    }
+
+    // Slow path: smaller classes may still hold a block that fits with its actual adjustment
+    const std::size_t lowestClass = SizeClassOf(RoundBlockSize(size, GetHeaderSize()));
+    FreeBlock* bestFit = nullptr;
+
+    for (std::size_t sizeClass = lowestClass; sizeClass <= floorClass && sizeClass < kNumSizeClasses; ++sizeClass)
+    {
+        for (FreeBlock* block = m_sizeClasses[sizeClass]; block != nullptr; block = block->index.list.next)
+        {
+            std::uintptr_t blockAdjustment = AdjustmentFor(block, alignment);
+            std::size_t blockTotalSize = RoundBlockSize(size, blockAdjustment);
+
+            if (static_cast<std::size_t>(block->size) >= blockTotalSize && (bestFit == nullptr || block->size < bestFit->size))
+            {
+                bestFit = block;
+                adjustment = blockAdjustment;
+                totalSize = blockTotalSize;
+            }
+        }
+
+        if (bestFit != nullptr)
+            break;
+    }
+
+    return bestFit;
+}
+
+
+template<typename Policies>
+void BasicFreeListAllocator<Policies>::InsertIntoSizeClass(FreeBlock* block) noexcept
+{
+    const std::size_t sizeClass = SizeClassOf(block->size);
+
+    PushToList(m_sizeClasses[sizeClass], block);
+    m_sizeClassMask |= std::uint64_t(1) << sizeClass;
+}
+
+
+template<typename Policies>
+void BasicFreeListAllocator<Policies>::RemoveFromSizeClass(FreeBlock* block) noexcept
+{
+    const std::size_t sizeClass = SizeClassOf(block->size);
+
+    RemoveFromList(m_sizeClasses[sizeClass], block);
+
+    if (m_sizeClasses[sizeClass] == nullptr)
+        m_sizeClassMask &= ~(std::uint64_t(1) << sizeClass);
+}
+
+
+template<typename Policies>
+typename BasicFreeListAllocator<Policies>::FreeBlock* BasicFreeListAllocator<Policies>::FindIndexedBestFit(const std::size_t& size, const std::uintptr_t& alignment,
+    std::uintptr_t& adjustment, std::size_t& totalSize) noexcept
+{
+    // Smallest block that could fit with the minimal adjustment
+    const std::size_t minimalSize = RoundBlockSize(size, GetHeaderSize());
+    FreeBlock* block = nullptr;
+
+    for (FreeBlock* node = m_treeRoot; node != nullptr; )
+    {
+        if (static_cast<std::size_t>(node->size) >= minimalSize)
+        {
+            block = node;
+            node = node->index.tree.left;
+        }
+        else
+        {
+            node = node->index.tree.right;
+        }
+    }
+
+    // Walk up in size order until the actual adjustment fits, any block of
+    // worstCase bytes or more always does, so the walk is bounded
+    const std::size_t worstCase = RoundBlockSize(size, GetHeaderSize() + alignment - 1u);
+
+    for (; block != nullptr; block = TreeSuccessor(block))
+    {
+        adjustment = AdjustmentFor(block, alignment);
+        totalSize = RoundBlockSize(size, adjustment);
+
+        if (static_cast<std::size_t>(block->size) >= totalSize)
+            return block;
+
+        assert(static_cast<std::size_t>(block->size) < worstCase);
+    }
+
+    return nullptr;
+}
+
+
+template<typename Policies>
+bool BasicFreeListAllocator<Policies>::TreeLess(const FreeBlock* lhs, const FreeBlock* rhs) noexcept
+{
+    return lhs->size < rhs->size || (lhs->size == rhs->size && lhs < rhs);
+}
+
+
+template<typename Policies>
+typename BasicFreeListAllocator<Policies>::FreeBlock* BasicFreeListAllocator<Policies>::TreeMinimum(FreeBlock* block) noexcept
+{
+    while (block->index.tree.left != nullptr)
+        block = block->index.tree.left;
+
+    return block;
+}
+
+
+template<typename Policies>
+typename BasicFreeListAllocator<Policies>::FreeBlock* BasicFreeListAllocator<Policies>::TreeSuccessor(FreeBlock* block) noexcept
+{
+    if (block->index.tree.right != nullptr)
+        return TreeMinimum(block->index.tree.right);
+
+    FreeBlock* parent = block->index.tree.parent;
+    while (parent != nullptr && block == parent->index.tree.right)
+    {
+        block = parent;
+        parent = parent->index.tree.parent;
+    }
+
+    return parent;
+}
+
+
+template<typename Policies>
+void BasicFreeListAllocator<Policies>::RotateLeft(FreeBlock* block) noexcept
+{
+    FreeBlock* pivot = block->index.tree.right;
+
+    block->index.tree.right = pivot->index.tree.left;
+    if (pivot->index.tree.left != nullptr)
+        pivot->index.tree.left->index.tree.parent = block;
+
+    Transplant(block, pivot);
+
+    pivot->index.tree.left = block;
+    block->index.tree.parent = pivot;
+}
+
+
+template<typename Policies>
+void BasicFreeListAllocator<Policies>::RotateRight(FreeBlock* block) noexcept
+{
+    FreeBlock* pivot = block->index.tree.left;
+
+    block->index.tree.left = pivot->index.tree.right;
+    if (pivot->index.tree.right != nullptr)
+        pivot->index.tree.right->index.tree.parent = block;
+
+    Transplant(block, pivot);
+
+    pivot->index.tree.right = block;
+    block->index.tree.parent = pivot;
+}
+
+
+// Puts the subtree rooted at to in place of the one rooted at from
+template<typename Policies>
+void BasicFreeListAllocator<Policies>::Transplant(FreeBlock* from, FreeBlock* to) noexcept
+{
+    FreeBlock* parent = from->index.tree.parent;
+
+    if (parent == nullptr)
+        m_treeRoot = to;
+    else if (from == parent->index.tree.left)
+        parent->index.tree.left = to;
+    else
+        parent->index.tree.right = to;
+
+    if (to != nullptr)
+        to->index.tree.parent = parent;
+}
+
+
+template<typename Policies>
+void BasicFreeListAllocator<Policies>::InsertIntoTree(FreeBlock* block) noexcept
+{
+    FreeBlock* parent = nullptr;
+    FreeBlock* node = m_treeRoot;
+
+    while (node != nullptr)
+    {
+        parent = node;
+        node = TreeLess(block, node) ? node->index.tree.left : node->index.tree.right;
+    }
+
+    block->index.tree.left = nullptr;
+    block->index.tree.right = nullptr;
+    block->index.tree.parent = parent;
+    block->red = true;
+
+    if (parent == nullptr)
+        m_treeRoot = block;
+    else if (TreeLess(block, parent))
+        parent->index.tree.left = block;
+    else
+        parent->index.tree.right = block;
+
+    while (block->index.tree.parent != nullptr && block->index.tree.parent->red)
+    {
+        parent = block->index.tree.parent;
+        FreeBlock* grandParent = parent->index.tree.parent;
+
+        if (parent == grandParent->index.tree.left)
+        {
+            FreeBlock* uncle = grandParent->index.tree.right;
+
+            if (uncle != nullptr && uncle->red)
+            {
+                parent->red = false;
+                uncle->red = false;
+                grandParent->red = true;
+                block = grandParent;
+            }
+            else
+            {
+                if (block == parent->index.tree.right)
+                {
+                    block = parent;
+                    RotateLeft(block);
+                    parent = block->index.tree.parent;
+                }
+
+                parent->red = false;
+                grandParent->red = true;
+                RotateRight(grandParent);
+            }
+        }
+        else
+        {
+            FreeBlock* uncle = grandParent->index.tree.left;
+
+            if (uncle != nullptr && uncle->red)
+            {
+                parent->red = false;
+                uncle->red = false;
+                grandParent->red = true;
+                block = grandParent;
+            }
+            else
+            {
+                if (block == parent->index.tree.left)
+                {
+                    block = parent;
+                    RotateRight(block);
+                    parent = block->index.tree.parent;
+                }
+
+                parent->red = false;
+                grandParent->red = true;
+                RotateLeft(grandParent);
+            }
+        }
+    }
+
+    m_treeRoot->red = false;
+}
+
+
+template<typename Policies>
+void BasicFreeListAllocator<Policies>::RemoveFromTree(FreeBlock* block) noexcept
+{
+    FreeBlock* child = nullptr;
+    FreeBlock* childParent = nullptr;
+    bool removedRed = block->red;
+
+    if (block->index.tree.left == nullptr)
+    {
+        child = block->index.tree.right;
+        childParent = block->index.tree.parent;
+        Transplant(block, child);
+    }
+    else if (block->index.tree.right == nullptr)
+    {
+        child = block->index.tree.left;
+        childParent = block->index.tree.parent;
+        Transplant(block, child);
+    }
+    else
+    {
+        // Replace the block by its successor, which has no left child
+        FreeBlock* successor = TreeMinimum(block->index.tree.right);
+        removedRed = successor->red;
+        child = successor->index.tree.right;
+
+        if (successor->index.tree.parent == block)
+        {
+            childParent = successor;
+        }
+        else
+        {
+            childParent = successor->index.tree.parent;
+            Transplant(successor, child);
+            successor->index.tree.right = block->index.tree.right;
+            successor->index.tree.right->index.tree.parent = successor;
+        }
+
+        Transplant(block, successor);
+        successor->index.tree.left = block->index.tree.left;
+        successor->index.tree.left->index.tree.parent = successor;
+        successor->red = block->red;
+    }
+
+    if (removedRed)
+        return;
+
+    while (child != m_treeRoot && (child == nullptr || !child->red))
+    {
+        if (child == childParent->index.tree.left)
+        {
+            FreeBlock* sibling = childParent->index.tree.right;
+
+            if (sibling->red)
+            {
+                sibling->red = false;
+                childParent->red = true;
+                RotateLeft(childParent);
+                sibling = childParent->index.tree.right;
+            }
+
+            if ((sibling->index.tree.left == nullptr || !sibling->index.tree.left->red) &&
+                (sibling->index.tree.right == nullptr || !sibling->index.tree.right->red))
+            {
+                sibling->red = true;
+                child = childParent;
+                childParent = child->index.tree.parent;
+            }
+            else
+            {
+                if (sibling->index.tree.right == nullptr || !sibling->index.tree.right->red)
+                {
+                    sibling->index.tree.left->red = false;
+                    sibling->red = true;
+                    RotateRight(sibling);
+                    sibling = childParent->index.tree.right;
+                }
+
+                sibling->red = childParent->red;
+                childParent->red = false;
+                if (sibling->index.tree.right != nullptr)
+                    sibling->index.tree.right->red = false;
+                RotateLeft(childParent);
+                child = m_treeRoot;
+            }
+        }
+        else
+        {
+            FreeBlock* sibling = childParent->index.tree.left;
+
+            if (sibling->red)
+            {
+                sibling->red = false;
+                childParent->red = true;
+                RotateRight(childParent);
+                sibling = childParent->index.tree.left;
+            }
+
+            if ((sibling->index.tree.left == nullptr || !sibling->index.tree.left->red) &&
+                (sibling->index.tree.right == nullptr || !sibling->index.tree.right->red))
+            {
+                sibling->red = true;
+                child = childParent;
+                childParent = child->index.tree.parent;
+            }
+            else
+            {
+                if (sibling->index.tree.left == nullptr || !sibling->index.tree.left->red)
+                {
+                    sibling->index.tree.right->red = false;
+                    sibling->red = true;
+                    RotateLeft(sibling);
+                    sibling = childParent->index.tree.left;
+                }
+
+                sibling->red = childParent->red;
+                childParent->red = false;
+                if (sibling->index.tree.left != nullptr)
+                    sibling->index.tree.left->red = false;
+                RotateRight(childParent);
+                child = m_treeRoot;
+            }
+        }
+    }
+
+    if (child != nullptr)
+        child->red = false;
+}
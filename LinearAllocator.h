@@ -0,0 +1,158 @@
+﻿#pragma once
+#include <new>
+#include <utility>
+#include "StaticAllocator.h"
+
+// Monotonic bump allocator over a caller-provided region.
+// Allocate only moves the top forward, Free never gives memory back, the whole region
+// is reclaimed at once by Reset or partially by rewinding to an earlier Marker.
+// m_usedBytes is the offset of the top, including alignment padding. The most recent allocation
+// can be resized in place, it ends at the top.
+class LinearAllocator final : public StaticAllocator<LinearAllocator>
+{
+public:
+    struct Marker
+    {
+        std::size_t offset;
+        std::size_t numAllocations;
+        std::size_t lastAllocation;
+    };
+
+    LinearAllocator(const std::size_t sizeBytes, void* start) noexcept;
+
+    LinearAllocator(const LinearAllocator&) = delete;
+    LinearAllocator& operator=(const LinearAllocator&) = delete;
+
+    LinearAllocator(LinearAllocator&&) noexcept;
+    LinearAllocator& operator=(LinearAllocator&&) noexcept;
+
+    // Everything still allocated dies with the allocator
+    ~LinearAllocator() noexcept override final;
+
+    virtual void* Allocate(const std::size_t& size, const std::uintptr_t& alignment = sizeof(std::intptr_t)) override final;
+
+    // Only bookkeeping, the memory comes back on Reset or Rewind
+    virtual void Free(void* const ptr) noexcept override final;
+    using StaticAllocator::Free;
+
+    // Bytes from ptr to the top, exact only for the most recent allocation
+    virtual std::size_t GetAllocationSize(const void* const ptr) const noexcept override final;
+
+    // Only the most recent allocation can change its size
+    virtual bool TryExpandInPlace(void* const ptr, const std::size_t& newSize) noexcept override final;
+
+    void Reset() noexcept;
+
+    Marker GetMarker() const noexcept;
+    void Rewind(const Marker& marker) noexcept;
+
+private:
+    static constexpr std::size_t kNoAllocation = ~std::size_t(0);
+
+protected:
+    std::size_t m_lastAllocation;       // offset of the most recent allocation, kNoAllocation when unknown
+};
+
+
+LinearAllocator::LinearAllocator(const std::size_t sizeBytes, void* start) noexcept
+    :
+    StaticAllocator(sizeBytes, start), m_lastAllocation(kNoAllocation)
+{}
+
+
+LinearAllocator::LinearAllocator(LinearAllocator&& other) noexcept
+    :
+    StaticAllocator(std::move(other)), m_lastAllocation(other.m_lastAllocation)
+{
+    other.m_lastAllocation = kNoAllocation;
+}
+
+
+LinearAllocator& LinearAllocator::operator=(LinearAllocator&& rhs) noexcept
+{
+    if (this != &rhs) {
+        StaticAllocator::operator=(std::move(rhs));
+        m_lastAllocation = rhs.m_lastAllocation;
+        rhs.m_lastAllocation = kNoAllocation;
+    }
+
+    return *this;
+}
+
+
+LinearAllocator::~LinearAllocator() noexcept
+{
+    Reset();
+}
+
+
+void* LinearAllocator::Allocate(const std::size_t& size, const std::uintptr_t& alignment)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1u)) == 0);
+
+    const std::uintptr_t top = reinterpret_cast<std::uintptr_t>(m_start) + m_usedBytes;
+    const std::size_t adjustment = static_cast<std::size_t>((0u - top) & (alignment - 1u));
+
+    if (size > m_size - m_usedBytes || adjustment > m_size - m_usedBytes - size)
+        throw std::bad_alloc();
+
+    m_lastAllocation = m_usedBytes + adjustment;
+    m_usedBytes += adjustment + size;
+    ++m_numAllocations;
+
+    return reinterpret_cast<void*>(top + adjustment);
+}
+
+
+void LinearAllocator::Free([[maybe_unused]] void* const ptr) noexcept
+{
+    assert(reinterpret_cast<std::uintptr_t>(ptr) - reinterpret_cast<std::uintptr_t>(m_start) < m_usedBytes);
+    assert(m_numAllocations > 0);
+
+    --m_numAllocations;
+}
+
+
+std::size_t LinearAllocator::GetAllocationSize(const void* const ptr) const noexcept
+{
+    const std::size_t offset = reinterpret_cast<std::uintptr_t>(ptr) - reinterpret_cast<std::uintptr_t>(m_start);
+    assert(offset < m_usedBytes);
+
+    return m_usedBytes - offset;
+}
+
+
+bool LinearAllocator::TryExpandInPlace(void* const ptr, const std::size_t& newSize) noexcept
+{
+    const std::size_t offset = reinterpret_cast<std::uintptr_t>(ptr) - reinterpret_cast<std::uintptr_t>(m_start);
+
+    if (offset != m_lastAllocation || newSize > m_size - offset)
+        return false;
+
+    m_usedBytes = offset + newSize;
+    return true;
+}
+
+
+void LinearAllocator::Reset() noexcept
+{
+    m_usedBytes = 0;
+    m_numAllocations = 0;
+    m_lastAllocation = kNoAllocation;
+}
+
+
+LinearAllocator::Marker LinearAllocator::GetMarker() const noexcept
+{
+    return Marker{ m_usedBytes, m_numAllocations, m_lastAllocation };
+}
+
+
+void LinearAllocator::Rewind(const Marker& marker) noexcept
+{
+    assert(marker.offset <= m_usedBytes);
+
+    m_usedBytes = marker.offset;
+    m_numAllocations = marker.numAllocations;
+    m_lastAllocation = marker.lastAllocation;
+}
@@ -0,0 +1,246 @@
+﻿#pragma once
+#include <atomic>
+#include <new>
+#include "StaticAllocator.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Lock-free fixed-size block pool over a caller-provided region.
+// Free blocks form a Treiber stack threaded through the blocks themselves, so there is
+// no per-allocation header. The head packs the index of the first free block with a
+// counter that changes on every push and pop, which makes the compare-and-swap ABA-safe
+// with a plain 64-bit atomic.
+//
+// The Allocator counters are the only count of blocks in use, each block counts as GetBlockSize
+// bytes. They are updated with interlocked adds, and PoolAllocator::GetUsed and GetNumAllocation
+// read them atomically; the Allocator getters are exact once the threads are done.
+class PoolAllocator final : public StaticAllocator<PoolAllocator>
+{
+public:
+    PoolAllocator(const std::size_t sizeBytes, void* start, const std::size_t blockSize,
+        const std::size_t blockAlignment = alignof(std::max_align_t)) noexcept;
+
+    PoolAllocator(const PoolAllocator&) = delete;
+    PoolAllocator& operator=(const PoolAllocator&) = delete;
+
+    // Other threads may hold pointers into the free stack, so the pool cannot be moved
+    PoolAllocator(PoolAllocator&&) = delete;
+    PoolAllocator& operator=(PoolAllocator&&) = delete;
+
+    ~PoolAllocator() noexcept override final;
+
+    virtual void* Allocate(const std::size_t& size, const std::uintptr_t& alignment = sizeof(std::intptr_t)) override final;
+    virtual void Free(void* const ptr) noexcept override final;
+    using StaticAllocator::Free;
+
+    virtual std::size_t GetAllocationSize(const void* const ptr) const noexcept override final;
+
+    std::size_t GetBlockSize() const noexcept;
+    std::size_t GetBlockCount() const noexcept;
+
+    // Hide the Allocator getters, which read the counters without synchronization
+    std::size_t GetUsed() const noexcept;
+    std::size_t GetNumAllocation() const noexcept;
+
+private:
+    using BlockLink = std::atomic<std::uint32_t>;   // index of the next free block, lives in the free block
+
+    static constexpr std::uint32_t kNullIndex = ~std::uint32_t(0);
+
+    static std::uint64_t Pack(const std::uint32_t& index, const std::uint32_t& tag) noexcept;
+    static std::uint32_t IndexOf(const std::uint64_t& head) noexcept;
+    static std::uint32_t TagOf(const std::uint64_t& head) noexcept;
+
+    void* BlockAt(const std::uint32_t& index) const noexcept;
+
+    // The counters belong to Allocator and are plain integers, concurrent threads add to them atomically
+    static void AtomicAdd(std::size_t& counter, const std::size_t& delta) noexcept;
+    static std::size_t AtomicLoad(const std::size_t& counter) noexcept;
+    void AddToCounters(const std::size_t& blocks, const std::size_t& bytes) noexcept;
+
+protected:
+    std::uintptr_t m_blocksStart;
+    std::size_t m_blockSize;            // stride between blocks
+    std::size_t m_blockAlignment;
+    std::uint32_t m_blockCount;
+
+    std::atomic<std::uint64_t> m_head;
+};
+
+
+PoolAllocator::PoolAllocator(const std::size_t sizeBytes, void* start, const std::size_t blockSize,
+    const std::size_t blockAlignment) noexcept
+    :
+    StaticAllocator(sizeBytes, start),
+    m_blocksStart(0), m_blockSize(0), m_blockAlignment(blockAlignment), m_blockCount(0),
+    m_head(Pack(kNullIndex, 0))
+{
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "PoolAllocator needs a lock-free 64-bit atomic");
+
+    assert(blockAlignment != 0 && (blockAlignment & (blockAlignment - 1u)) == 0);
+    assert(blockAlignment >= alignof(BlockLink));
+
+    const std::size_t minimalSize = blockSize > sizeof(BlockLink) ? blockSize : sizeof(BlockLink);
+    m_blockSize = (minimalSize + blockAlignment - 1u) & ~(blockAlignment - 1u);
+
+    const std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(start);
+    const std::uintptr_t end = begin + sizeBytes;
+    m_blocksStart = (begin + blockAlignment - 1u) & ~(blockAlignment - 1u);
+
+    std::size_t blockCount = m_blocksStart < end ? (end - m_blocksStart) / m_blockSize : 0;
+    if (blockCount > kNullIndex)
+        blockCount = kNullIndex;
+
+    m_blockCount = static_cast<std::uint32_t>(blockCount);
+    assert(m_blockCount > 0);
+
+    for (std::uint32_t index = 0; index < m_blockCount; ++index)
+        new (BlockAt(index)) BlockLink(index + 1u < m_blockCount ? index + 1u : kNullIndex);
+
+    m_head.store(Pack(m_blockCount > 0 ? 0 : kNullIndex, 0), std::memory_order_release);
+}
+
+
+PoolAllocator::~PoolAllocator() noexcept
+{
+    assert(AtomicLoad(m_numAllocations) == 0);
+}
+
+
+void* PoolAllocator::Allocate(const std::size_t& size, const std::uintptr_t& alignment)
+{
+    if (size > m_blockSize || alignment > m_blockAlignment)
+        throw std::bad_alloc();
+
+    std::uint64_t head = m_head.load(std::memory_order_acquire);
+    std::uint32_t index;
+
+    for (;;)
+    {
+        index = IndexOf(head);
+        if (index == kNullIndex)
+            throw std::bad_alloc();
+
+        // The block may be popped and overwritten by another thread meanwhile,
+        // then the tag has moved on and the exchange below fails
+        const std::uint32_t next = static_cast<BlockLink*>(BlockAt(index))->load(std::memory_order_relaxed);
+
+        if (m_head.compare_exchange_weak(head, Pack(next, TagOf(head) + 1u),
+            std::memory_order_acquire, std::memory_order_acquire))
+            break;
+    }
+
+    AddToCounters(1u, m_blockSize);
+    return BlockAt(index);
+}
+
+
+void PoolAllocator::Free(void* const ptr) noexcept
+{
+    assert(ptr != nullptr);
+
+    const std::uintptr_t offset = reinterpret_cast<std::uintptr_t>(ptr) - m_blocksStart;
+    assert(reinterpret_cast<std::uintptr_t>(ptr) >= m_blocksStart && offset % m_blockSize == 0);
+
+    const std::uint32_t index = static_cast<std::uint32_t>(offset / m_blockSize);
+    assert(index < m_blockCount);
+
+    BlockLink* link = new (ptr) BlockLink(kNullIndex);
+    std::uint64_t head = m_head.load(std::memory_order_relaxed);
+
+    do
+    {
+        link->store(IndexOf(head), std::memory_order_relaxed);
+    } while (!m_head.compare_exchange_weak(head, Pack(index, TagOf(head) + 1u),
+        std::memory_order_release, std::memory_order_relaxed));
+
+    // Unsigned wrap-around turns the adds into subtractions
+    AddToCounters(~std::size_t(0), std::size_t(0) - m_blockSize);
+}
+
+
+std::size_t PoolAllocator::GetAllocationSize([[maybe_unused]] const void* const ptr) const noexcept
+{
+    assert(ptr != nullptr);
+    return m_blockSize;
+}
+
+
+std::size_t PoolAllocator::GetBlockSize() const noexcept
+{
+    return m_blockSize;
+}
+
+
+std::size_t PoolAllocator::GetBlockCount() const noexcept
+{
+    return m_blockCount;
+}
+
+
+std::size_t PoolAllocator::GetUsed() const noexcept
+{
+    return AtomicLoad(m_usedBytes);
+}
+
+
+std::size_t PoolAllocator::GetNumAllocation() const noexcept
+{
+    return AtomicLoad(m_numAllocations);
+}
+
+
+std::uint64_t PoolAllocator::Pack(const std::uint32_t& index, const std::uint32_t& tag) noexcept
+{
+    return (static_cast<std::uint64_t>(tag) << 32) | index;
+}
+
+
+std::uint32_t PoolAllocator::IndexOf(const std::uint64_t& head) noexcept
+{
+    return static_cast<std::uint32_t>(head);
+}
+
+
+std::uint32_t PoolAllocator::TagOf(const std::uint64_t& head) noexcept
+{
+    return static_cast<std::uint32_t>(head >> 32);
+}
+
+
+void* PoolAllocator::BlockAt(const std::uint32_t& index) const noexcept
+{
+    return reinterpret_cast<void*>(m_blocksStart + static_cast<std::uintptr_t>(index) * m_blockSize);
+}
+
+
+void PoolAllocator::AtomicAdd(std::size_t& counter, const std::size_t& delta) noexcept
+{
+#if defined(_MSC_VER) && defined(_WIN64)
+    _InterlockedExchangeAdd64(reinterpret_cast<volatile long long*>(&counter), static_cast<long long>(delta));
+#elif defined(_MSC_VER)
+    _InterlockedExchangeAdd(reinterpret_cast<volatile long*>(&counter), static_cast<long>(delta));
+#else
+    __atomic_fetch_add(&counter, delta, __ATOMIC_RELAXED);
+#endif
+}
+
+
+std::size_t PoolAllocator::AtomicLoad(const std::size_t& counter) noexcept
+{
+#if defined(_MSC_VER)
+    // Aligned loads of a machine word are atomic on every target MSVC supports, volatile keeps the compiler from caching it
+    return *static_cast<const volatile std::size_t*>(&counter);
+#else
+    return __atomic_load_n(&counter, __ATOMIC_RELAXED);
+#endif
+}
+
+
+void PoolAllocator::AddToCounters(const std::size_t& blocks, const std::size_t& bytes) noexcept
+{
+    AtomicAdd(m_numAllocations, blocks);
+    AtomicAdd(m_usedBytes, bytes);
+}
@@ -1,93 +1,103 @@
-﻿#pragma once
-#include <iostream>
-#include <type_traits>
-#include "FixedAllocator.h"
-#include "DynamicAllocator.h"
-
-template<typename T, typename Alloc>
-class STLAdaptor
-{
-public:
-
-    typedef T value_type;
-
-
-    STLAdaptor() = delete;
-
-
-    STLAdaptor(Alloc& allocator) noexcept
-        :
-        m_allocator(allocator)
-    {}
-
-
-    template<typename U>
-    STLAdaptor(const STLAdaptor<U, Alloc>& other) noexcept
-        :
-        m_allocator(other.m_allocator)
-    {}
-
-
-    [[nodiscard]] constexpr T* allocate(std::size_t n)
-    {
-        printf("number of n * sizeof(T): %zu * %zu\n", n, sizeof(T));
-        return reinterpret_cast<T*>
-            (m_allocator.Allocate(n * sizeof(T), alignof(T)));
-    }
-
-
-    constexpr void deallocate(T* p, [[maybe_unused]] std::size_t n)
-        noexcept
-    {
-        printf("Deallocation <-- STLAdapt: %p\n", p);
-        m_allocator.Free(p);
-    }
-
-    std::size_t MaxAllocationSize() const noexcept
-    {
-        return m_allocator.GetSize();
-    }
-
-
-    bool operator==(const STLAdaptor<T, Alloc>& rhs) const noexcept
-    {
-        if constexpr (std::is_base_of_v<FixedAllocator, Alloc>)
-        {
-            return m_allocator.GetStart() == rhs.m_allocator.GetStart();
-        }
-        else
-        {
-            const auto* left = dynamic_cast<const DynamicAllocator*>(&m_allocator);
-            const auto* right = dynamic_cast<const DynamicAllocator*>(&rhs.m_allocator);
-
-            if (!left || !right)
-            {
-                return false;
-            }
-
-            DynamicAllocator::BlockDesc* a = left->m_currentBlock;
-
-            while (a->prevBlock != nullptr)
-            {
-                a = a->prevBlock;
-            }
-
-            DynamicAllocator::BlockDesc* b = right->m_currentBlock;
-            while (b->prevBlock != nullptr)
-            {
-                b = b->prevBlock;
-            }
-
-            return a == b;
-        }
-    }
-
-
-    bool operator!=(const STLAdaptor<T, Alloc>& rhs) const noexcept
-    {
-        return !(*this == rhs);
-    }
-
-
-    Alloc& m_allocator;
-};
+﻿#pragma once
+#include <type_traits>
+#include "FixedAllocator.h"
+#include "AllocationTrace.h"
+#include "DynamicAllocator.h"
+
+// Alloc is the static type: the allocators are final, so their calls bind without the vtable,
+// Alloc = Allocator keeps virtual dispatch. Trace is the sink for allocate/deallocate, see AllocationTrace.h
+template<typename T, typename Alloc, typename Trace = NoTrace>
+class STLAdaptor
+{
+public:
+
+    typedef T value_type;
+
+
+    STLAdaptor() = delete;
+
+
+    STLAdaptor(Alloc& allocator) noexcept
+        :
+        m_allocator(allocator)
+    {}
+
+
+    template<typename U>
+    STLAdaptor(const STLAdaptor<U, Alloc, Trace>& other) noexcept
+        :
+        m_allocator(other.m_allocator)
+    {}
+
+
+    [[nodiscard]] constexpr T* allocate(std::size_t n)
+    {
+        T* p = reinterpret_cast<T*>
+            (m_allocator.Allocate(n * sizeof(T), alignof(T)));
+
+        Trace::Record({ TraceOp::Allocate, n * sizeof(T), alignof(T), p, &m_allocator, FREELIST_TRACE_CALLER() });
+        return p;
+    }
+
+
+    constexpr void deallocate(T* p, std::size_t n)
+        noexcept
+    {
+        Trace::Record({ TraceOp::Free, n * sizeof(T), alignof(T), p, &m_allocator, FREELIST_TRACE_CALLER() });
+        m_allocator.Free(p, n * sizeof(T));
+    }
+
+    std::size_t MaxAllocationSize() const noexcept
+    {
+        return m_allocator.GetSize();
+    }
+
+
+    bool operator==(const STLAdaptor<T, Alloc, Trace>& rhs) const noexcept
+    {
+        // Composites such as Segregator are neither fixed arenas nor DynamicAllocators
+        if (&m_allocator == &rhs.m_allocator)
+        {
+            return true;
+        }
+
+        if constexpr (std::is_base_of_v<FixedAllocator, Alloc>)
+        {
+            return m_allocator.GetStart() == rhs.m_allocator.GetStart();
+        }
+        else
+        {
+            const auto* left = dynamic_cast<const DynamicAllocator*>(&m_allocator);
+            const auto* right = dynamic_cast<const DynamicAllocator*>(&rhs.m_allocator);
+
+            if (!left || !right)
+            {
+                return false;
+            }
+
+            DynamicAllocator::BlockDesc* a = left->m_currentBlock;
+
+            while (a->prevBlock != nullptr)
+            {
+                a = a->prevBlock;
+            }
+
+            DynamicAllocator::BlockDesc* b = right->m_currentBlock;
+            while (b->prevBlock != nullptr)
+            {
+                b = b->prevBlock;
+            }
+
+            return a == b;
+        }
+    }
+
+
+    bool operator!=(const STLAdaptor<T, Alloc, Trace>& rhs) const noexcept
+    {
+        return !(*this == rhs);
+    }
+
+
+    Alloc& m_allocator;
+};
@@ -0,0 +1,216 @@
+﻿#pragma once
+#include <new>
+#include "StaticAllocator.h"
+
+// Routes requests up to Threshold bytes to Small and larger ones to Large, e.g. a pool for
+// small objects in front of a FreeListAllocator. Both allocators are borrowed and must outlive
+// the Segregator. Sized Free picks the side from the size alone, Free(ptr) asks Small whether it
+// owns ptr. Segregators nest: Large may itself be a Segregator with a higher threshold.
+//
+// GetStart is the start of Small, GetSize the two sizes together, the counters track the
+// allocations made through the Segregator.
+template<std::size_t Threshold, typename Small, typename Large>
+class Segregator final : public StaticAllocator<Segregator<Threshold, Small, Large>, Allocator>
+{
+    using Base = StaticAllocator<Segregator<Threshold, Small, Large>, Allocator>;
+
+public:
+    Segregator(Small& small, Large& large) noexcept;
+
+    Segregator(const Segregator&) = delete;
+    Segregator& operator=(const Segregator&) = delete;
+
+    Segregator(Segregator&&) = delete;
+    Segregator& operator=(Segregator&&) = delete;
+
+    ~Segregator() noexcept override final;
+
+    virtual void* Allocate(const std::size_t& size, const std::uintptr_t& alignment = sizeof(std::intptr_t)) override final;
+    virtual void Free(void* const ptr) noexcept override final;
+    virtual void Free(void* const ptr, const std::size_t& size) noexcept override final;
+
+    virtual std::size_t GetAllocationSize(const void* const ptr) const noexcept override final;
+    virtual bool Owns(const void* const ptr) const noexcept override final;
+
+    // Only within the side that holds ptr, and never across Threshold, so the size keeps picking the right side
+    virtual bool TryExpandInPlace(void* const ptr, const std::size_t& newSize) noexcept override final;
+
+    // The whole batch goes to one side, so its own batch path is used
+    virtual void AllocateBatch(const std::size_t& count, const std::size_t& size, const std::uintptr_t& alignment,
+        void** out) override final;
+
+    Small& GetSmall() const noexcept;
+    Large& GetLarge() const noexcept;
+
+private:
+    template<typename Side>
+    void* AllocateFrom(Side& side, const std::size_t& size, const std::uintptr_t& alignment);
+    template<typename Side>
+    void FreeTo(Side& side, void* const ptr, const std::size_t& size) noexcept;
+    template<typename Side>
+    bool ExpandIn(Side& side, void* const ptr, const std::size_t& newSize) noexcept;
+
+protected:
+    using Base::m_usedBytes;
+    using Base::m_numAllocations;
+
+    Small& m_small;
+    Large& m_large;
+};
+
+
+template<std::size_t Threshold, typename Small, typename Large>
+Segregator<Threshold, Small, Large>::Segregator(Small& small, Large& large) noexcept
+    :
+    Base(small.GetSize() + large.GetSize(), const_cast<void*>(small.GetStart())),
+    m_small(small), m_large(large)
+{}
+
+
+template<std::size_t Threshold, typename Small, typename Large>
+Segregator<Threshold, Small, Large>::~Segregator() noexcept
+{}
+
+
+template<std::size_t Threshold, typename Small, typename Large>
+void* Segregator<Threshold, Small, Large>::Allocate(const std::size_t& size, const std::uintptr_t& alignment)
+{
+    if (size <= Threshold)
+        return AllocateFrom(m_small, size, alignment);
+
+    return AllocateFrom(m_large, size, alignment);
+}
+
+
+template<std::size_t Threshold, typename Small, typename Large>
+void Segregator<Threshold, Small, Large>::Free(void* const ptr) noexcept
+{
+    assert(ptr != nullptr);
+
+    if (m_small.Owns(ptr))
+        FreeTo(m_small, ptr, 0);
+    else
+        FreeTo(m_large, ptr, 0);
+}
+
+
+template<std::size_t Threshold, typename Small, typename Large>
+void Segregator<Threshold, Small, Large>::Free(void* const ptr, const std::size_t& size) noexcept
+{
+    assert(ptr != nullptr);
+
+    if (size <= Threshold)
+        FreeTo(m_small, ptr, size);
+    else
+        FreeTo(m_large, ptr, size);
+}
+
+
+template<std::size_t Threshold, typename Small, typename Large>
+std::size_t Segregator<Threshold, Small, Large>::GetAllocationSize(const void* const ptr) const noexcept
+{
+    if (m_small.Owns(ptr))
+        return m_small.GetAllocationSize(ptr);
+
+    return m_large.GetAllocationSize(ptr);
+}
+
+
+template<std::size_t Threshold, typename Small, typename Large>
+bool Segregator<Threshold, Small, Large>::Owns(const void* const ptr) const noexcept
+{
+    return m_small.Owns(ptr) || m_large.Owns(ptr);
+}
+
+
+template<std::size_t Threshold, typename Small, typename Large>
+bool Segregator<Threshold, Small, Large>::TryExpandInPlace(void* const ptr, const std::size_t& newSize) noexcept
+{
+    assert(ptr != nullptr);
+
+    if (m_small.Owns(ptr))
+        return newSize <= Threshold && ExpandIn(m_small, ptr, newSize);
+
+    return newSize > Threshold && ExpandIn(m_large, ptr, newSize);
+}
+
+
+template<std::size_t Threshold, typename Small, typename Large>
+void Segregator<Threshold, Small, Large>::AllocateBatch(const std::size_t& count, const std::size_t& size,
+    const std::uintptr_t& alignment, void** out)
+{
+    if (size <= Threshold)
+    {
+        const std::size_t usedBefore = m_small.GetUsed();
+        m_small.AllocateBatch(count, size, alignment, out);
+        m_usedBytes += m_small.GetUsed() - usedBefore;
+    }
+    else
+    {
+        const std::size_t usedBefore = m_large.GetUsed();
+        m_large.AllocateBatch(count, size, alignment, out);
+        m_usedBytes += m_large.GetUsed() - usedBefore;
+    }
+
+    m_numAllocations += count;
+}
+
+
+template<std::size_t Threshold, typename Small, typename Large>
+Small& Segregator<Threshold, Small, Large>::GetSmall() const noexcept
+{
+    return m_small;
+}
+
+
+template<std::size_t Threshold, typename Small, typename Large>
+Large& Segregator<Threshold, Small, Large>::GetLarge() const noexcept
+{
+    return m_large;
+}
+
+
+template<std::size_t Threshold, typename Small, typename Large>
+template<typename Side>
+void* Segregator<Threshold, Small, Large>::AllocateFrom(Side& side, const std::size_t& size, const std::uintptr_t& alignment)
+{
+    const std::size_t usedBefore = side.GetUsed();
+    void* ptr = side.Allocate(size, alignment);
+
+    m_usedBytes += side.GetUsed() - usedBefore;
+    ++m_numAllocations;
+
+    return ptr;
+}
+
+
+// size 0 means unknown and takes the unsized Free of the side
+template<std::size_t Threshold, typename Small, typename Large>
+template<typename Side>
+void Segregator<Threshold, Small, Large>::FreeTo(Side& side, void* const ptr, const std::size_t& size) noexcept
+{
+    assert(m_numAllocations > 0);
+
+    const std::size_t usedBefore = side.GetUsed();
+
+    if (size == 0)
+        side.Free(ptr);
+    else
+        side.Free(ptr, size);
+
+    m_usedBytes -= usedBefore - side.GetUsed();
+    --m_numAllocations;
+}
+
+
+template<std::size_t Threshold, typename Small, typename Large>
+template<typename Side>
+bool Segregator<Threshold, Small, Large>::ExpandIn(Side& side, void* const ptr, const std::size_t& newSize) noexcept
+{
+    const std::size_t usedBefore = side.GetUsed();
+    if (!side.TryExpandInPlace(ptr, newSize))
+        return false;
+
+    m_usedBytes = m_usedBytes - usedBefore + side.GetUsed();
+    return true;
+}
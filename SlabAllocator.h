@@ -0,0 +1,542 @@
+﻿#pragma once
+#include <new>
+#include "FreeListAllocatorCustom.h"
+#include "BitOperations.h"
+
+// Slab layer over a backing FreeListAllocator.
+// Requests up to kMaxSlabObject bytes are rounded to a multiple of 8 and served from the cache of
+// that size: slabs of m_slabSize bytes carved from the backing arena, each holding same-size objects
+// and a free bitmap, with no per-object header. Larger or over-aligned requests go to the backing
+// allocator directly.
+//
+// Slabs start on a kPageSize boundary. A page map with one entry per page of the backing arena tells
+// which slab, if any, owns a page, so Free sorts slab objects from backing allocations in O(1).
+// The page map is allocated from the backing arena too and doubles as GetStart and GetSize, so two
+// slab layers over the same arena never compare equal in STLAdaptor. Owns answers from the page map
+// and a table of this layer's large allocations, other users of the backing arena are not claimed.
+class SlabAllocator final : public StaticAllocator<SlabAllocator>
+{
+public:
+    explicit SlabAllocator(FreeListAllocator& backing, const std::size_t slabSize = kDefaultSlabSize);
+
+    SlabAllocator(const SlabAllocator&) = delete;
+    SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+    // Slabs point back at the caches inside the allocator, it cannot be moved
+    SlabAllocator(SlabAllocator&&) = delete;
+    SlabAllocator& operator=(SlabAllocator&&) = delete;
+
+    ~SlabAllocator() noexcept override final;
+
+    virtual void* Allocate(const std::size_t& size, const std::uintptr_t& alignment = sizeof(std::intptr_t)) override final;
+    virtual void Free(void* const ptr) noexcept override final;
+
+    // Objects larger than kMaxSlabObject never live in a slab, they skip the page map
+    virtual void Free(void* const ptr, const std::size_t& size) noexcept override final;
+
+    virtual std::size_t GetAllocationSize(const void* const ptr) const noexcept override final;
+
+    // Slab objects of this layer and the large blocks it took from the backing allocator
+    virtual bool Owns(const void* const ptr) const noexcept override final;
+
+    std::size_t GetSlabCount() const noexcept;
+
+    static constexpr std::size_t kPageSize = 4096;
+    static constexpr std::size_t kDefaultSlabSize = 64 * 1024;
+    static constexpr std::size_t kMaxSlabObject = 512;
+    static constexpr std::size_t kMaxSlabAlignment = 64;
+
+private:
+    struct Slab;
+    struct SizeCache;
+
+    static constexpr std::size_t kNumSizeClasses = kMaxSlabObject / 8u;
+
+    // Slabs are requested this much shorter than m_slabSize, which leaves room for the backing
+    // allocator's header in front of the next slab, so consecutive slabs pack without padding
+    static constexpr std::size_t kSlabTailReserve = 32;
+
+    void InitSizeCache(SizeCache& cache, const std::size_t& objectSize) noexcept;
+
+    void FreeToBacking(void* const ptr) noexcept;
+
+    Slab* CreateSlab(const std::size_t& sizeClass);
+    void DestroySlab(Slab* const slab) noexcept;
+
+    void LinkPartial(SizeCache& cache, Slab* const slab) noexcept;
+    void UnlinkPartial(SizeCache& cache, Slab* const slab) noexcept;
+
+    Slab* FindSlab(const void* const ptr) const noexcept;
+    std::uint64_t* FreeMapOf(Slab* const slab) const noexcept;
+
+    // Open-addressing set of the large blocks, linear probing with backward-shift erase
+    void InsertLarge(const void* const ptr);
+    void EraseLarge(const void* const ptr) noexcept;
+    bool ContainsLarge(const void* const ptr) const noexcept;
+    std::size_t LargeHomeOf(const void* const ptr) const noexcept;
+    void GrowLargeTable();
+
+protected:
+    FreeListAllocator& m_backing;
+    std::size_t m_slabSize;
+
+    std::uintptr_t m_pageBase;          // backing arena start rounded down to kPageSize
+    std::size_t m_numPages;
+    std::uint32_t* m_pageMap;           // first page of the owning slab + 1, 0 for none
+
+    SizeCache* m_caches;
+    std::size_t m_slabCount;
+
+    const void** m_largeTable;          // nullptr marks an empty slot, allocated from the backing arena
+    std::size_t m_largeCapacity;        // power of two, 0 until the first large allocation
+    std::size_t m_largeCount;
+};
+
+
+struct SlabAllocator::Slab
+{
+    Slab* next;                         // partial list of the cache
+    Slab* prev;
+    std::uint32_t sizeClass;
+    std::uint32_t freeCount;
+    std::uint32_t hintWord;             // no free bits below this word
+    bool partial;
+};
+
+
+struct SlabAllocator::SizeCache
+{
+    Slab* partial;                      // slabs with at least one free object
+    std::uint32_t objectSize;
+    std::uint32_t capacity;             // objects per slab
+    std::uint32_t mapWords;
+    std::uint32_t objectsOffset;        // from the slab start, kMaxSlabAlignment aligned
+};
+
+
+SlabAllocator::SlabAllocator(FreeListAllocator& backing, const std::size_t slabSize)
+    :
+    StaticAllocator(backing.GetSize(), const_cast<void*>(backing.GetStart())),
+    m_backing(backing), m_slabSize(slabSize),
+    m_pageBase(0), m_numPages(0), m_pageMap(nullptr), m_caches(nullptr), m_slabCount(0),
+    m_largeTable(nullptr), m_largeCapacity(0), m_largeCount(0)
+{
+    assert(slabSize >= 2u * kPageSize && slabSize % kPageSize == 0);
+
+    const std::uintptr_t arenaStart = reinterpret_cast<std::uintptr_t>(backing.GetStart());
+    const std::uintptr_t arenaEnd = arenaStart + backing.GetSize();
+
+    m_pageBase = arenaStart & ~(kPageSize - 1u);
+    m_numPages = (arenaEnd - m_pageBase + kPageSize - 1u) / kPageSize;
+
+    m_pageMap = static_cast<std::uint32_t*>(m_backing.Allocate(m_numPages * sizeof(std::uint32_t), alignof(std::uint32_t)));
+    for (std::size_t i = 0; i < m_numPages; ++i)
+        m_pageMap[i] = 0;
+
+    try
+    {
+        m_caches = static_cast<SizeCache*>(m_backing.Allocate(kNumSizeClasses * sizeof(SizeCache), alignof(SizeCache)));
+    }
+    catch (const std::bad_alloc&)
+    {
+        m_backing.Free(m_pageMap);
+        throw;
+    }
+
+    for (std::size_t i = 0; i < kNumSizeClasses; ++i)
+        InitSizeCache(m_caches[i], (i + 1u) * 8u);
+
+    m_start = m_pageMap;
+    m_size = m_numPages * sizeof(std::uint32_t);
+}
+
+
+SlabAllocator::~SlabAllocator() noexcept
+{
+    for (std::size_t i = 0; i < kNumSizeClasses; ++i)
+    {
+        while (m_caches[i].partial != nullptr)
+        {
+            Slab* slab = m_caches[i].partial;
+            UnlinkPartial(m_caches[i], slab);
+            DestroySlab(slab);
+        }
+    }
+
+    assert(m_slabCount == 0 && m_largeCount == 0);
+
+    if (m_largeTable != nullptr)
+        m_backing.Free(m_largeTable);
+
+    m_backing.Free(m_caches);
+    m_backing.Free(m_pageMap);
+}
+
+
+void* SlabAllocator::Allocate(const std::size_t& size, const std::uintptr_t& alignment)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1u)) == 0);
+
+    // A multiple of the alignment keeps every object of the class aligned
+    const std::size_t objectSize = ((size > 0 ? size : 1u) + alignment - 1u) & ~(alignment - 1u);
+
+    if (objectSize > kMaxSlabObject || alignment > kMaxSlabAlignment)
+    {
+        // The table grows first, so a failure there leaves no block behind
+        if ((m_largeCount + 1u) * 2u > m_largeCapacity)
+            GrowLargeTable();
+
+        const std::size_t usedBefore = m_backing.GetUsed();
+        void* ptr = m_backing.Allocate(size, alignment);
+        InsertLarge(ptr);
+
+        m_usedBytes += m_backing.GetUsed() - usedBefore;
+        ++m_numAllocations;
+        return ptr;
+    }
+
+    const std::size_t sizeClass = (objectSize + 7u) / 8u - 1u;
+    SizeCache& cache = m_caches[sizeClass];
+
+    Slab* slab = cache.partial != nullptr ? cache.partial : CreateSlab(sizeClass);
+
+    std::uint64_t* freeMap = FreeMapOf(slab);
+    std::uint32_t word = slab->hintWord;
+    while (freeMap[word] == 0)
+        ++word;
+
+    const unsigned bit = FindLowestSetBit(freeMap[word]);
+    freeMap[word] &= freeMap[word] - 1u;
+    slab->hintWord = word;
+
+    if (--slab->freeCount == 0)
+        UnlinkPartial(cache, slab);
+
+    m_usedBytes += cache.objectSize;
+    ++m_numAllocations;
+
+    const std::size_t index = static_cast<std::size_t>(word) * 64u + bit;
+    return reinterpret_cast<void*>(reinterpret_cast<std::uintptr_t>(slab) + cache.objectsOffset + index * cache.objectSize);
+}
+
+
+void SlabAllocator::Free(void* const ptr) noexcept
+{
+    assert(ptr != nullptr);
+
+    Slab* slab = FindSlab(ptr);
+
+    if (slab == nullptr)
+    {
+        FreeToBacking(ptr);
+        return;
+    }
+
+    SizeCache& cache = m_caches[slab->sizeClass];
+
+    const std::size_t offset = reinterpret_cast<std::uintptr_t>(ptr) - reinterpret_cast<std::uintptr_t>(slab) - cache.objectsOffset;
+    assert(offset % cache.objectSize == 0);
+
+    const std::size_t index = offset / cache.objectSize;
+    const std::uint32_t word = static_cast<std::uint32_t>(index / 64u);
+    const std::uint64_t bit = std::uint64_t(1) << (index % 64u);
+
+    std::uint64_t* freeMap = FreeMapOf(slab);
+    assert((freeMap[word] & bit) == 0);
+
+    freeMap[word] |= bit;
+    if (word < slab->hintWord)
+        slab->hintWord = word;
+
+    m_usedBytes -= cache.objectSize;
+    --m_numAllocations;
+
+    if (++slab->freeCount == 1u)
+        LinkPartial(cache, slab);
+
+    // An empty slab goes back to the backing arena unless it is the last one with room
+    if (slab->freeCount == cache.capacity && (slab->next != nullptr || slab->prev != nullptr))
+    {
+        UnlinkPartial(cache, slab);
+        DestroySlab(slab);
+    }
+}
+
+
+void SlabAllocator::Free(void* const ptr, const std::size_t& size) noexcept
+{
+    assert(ptr != nullptr);
+
+    if (size > kMaxSlabObject)
+    {
+        assert(FindSlab(ptr) == nullptr);
+        FreeToBacking(ptr);
+        return;
+    }
+
+    assert(size <= GetAllocationSize(ptr));
+    Free(ptr);
+}
+
+
+std::size_t SlabAllocator::GetAllocationSize(const void* const ptr) const noexcept
+{
+    assert(ptr != nullptr);
+
+    const Slab* slab = FindSlab(ptr);
+    if (slab == nullptr)
+        return m_backing.GetAllocationSize(ptr);
+
+    return m_caches[slab->sizeClass].objectSize;
+}
+
+
+bool SlabAllocator::Owns(const void* const ptr) const noexcept
+{
+    return FindSlab(ptr) != nullptr || ContainsLarge(ptr);
+}
+
+
+std::size_t SlabAllocator::GetSlabCount() const noexcept
+{
+    return m_slabCount;
+}
+
+
+void SlabAllocator::FreeToBacking(void* const ptr) noexcept
+{
+    EraseLarge(ptr);
+
+    const std::size_t usedBefore = m_backing.GetUsed();
+    m_backing.Free(ptr);
+
+    m_usedBytes -= usedBefore - m_backing.GetUsed();
+    --m_numAllocations;
+}
+
+
+void SlabAllocator::InitSizeCache(SizeCache& cache, const std::size_t& objectSize) noexcept
+{
+    const std::size_t usable = m_slabSize - kSlabTailReserve;
+
+    std::size_t capacity = usable / objectSize;
+    std::size_t objectsOffset = 0;
+
+    // The bitmap shrinks with the capacity, stop at the first capacity that fits with it
+    for (;;)
+    {
+        const std::size_t mapWords = (capacity + 63u) / 64u;
+        objectsOffset = (sizeof(Slab) + mapWords * sizeof(std::uint64_t) + kMaxSlabAlignment - 1u) & ~(kMaxSlabAlignment - 1u);
+
+        if (objectsOffset + capacity * objectSize <= usable)
+            break;
+
+        --capacity;
+    }
+
+    cache.partial = nullptr;
+    cache.objectSize = static_cast<std::uint32_t>(objectSize);
+    cache.capacity = static_cast<std::uint32_t>(capacity);
+    cache.mapWords = static_cast<std::uint32_t>((capacity + 63u) / 64u);
+    cache.objectsOffset = static_cast<std::uint32_t>(objectsOffset);
+}
+
+
+SlabAllocator::Slab* SlabAllocator::CreateSlab(const std::size_t& sizeClass)
+{
+    SizeCache& cache = m_caches[sizeClass];
+
+    void* memory = m_backing.TryAllocate(m_slabSize - kSlabTailReserve, kPageSize);
+    if (memory == nullptr)
+        throw std::bad_alloc();
+
+    Slab* slab = new (memory) Slab;
+    slab->next = nullptr;
+    slab->prev = nullptr;
+    slab->sizeClass = static_cast<std::uint32_t>(sizeClass);
+    slab->freeCount = cache.capacity;
+    slab->hintWord = 0;
+    slab->partial = false;
+
+    std::uint64_t* freeMap = FreeMapOf(slab);
+    for (std::uint32_t i = 0; i < cache.mapWords; ++i)
+        freeMap[i] = ~std::uint64_t(0);
+    if (cache.capacity % 64u != 0)
+        freeMap[cache.mapWords - 1u] = (std::uint64_t(1) << (cache.capacity % 64u)) - 1u;
+
+    const std::size_t firstPage = (reinterpret_cast<std::uintptr_t>(slab) - m_pageBase) / kPageSize;
+    for (std::size_t page = 0; page < m_slabSize / kPageSize; ++page)
+        m_pageMap[firstPage + page] = static_cast<std::uint32_t>(firstPage + 1u);
+
+    ++m_slabCount;
+
+    LinkPartial(cache, slab);
+    return slab;
+}
+
+
+void SlabAllocator::DestroySlab(Slab* const slab) noexcept
+{
+    const std::size_t firstPage = (reinterpret_cast<std::uintptr_t>(slab) - m_pageBase) / kPageSize;
+    for (std::size_t page = 0; page < m_slabSize / kPageSize; ++page)
+        m_pageMap[firstPage + page] = 0;
+
+    --m_slabCount;
+
+    m_backing.Free(slab);
+}
+
+
+void SlabAllocator::LinkPartial(SizeCache& cache, Slab* const slab) noexcept
+{
+    assert(!slab->partial);
+
+    slab->prev = nullptr;
+    slab->next = cache.partial;
+
+    if (cache.partial != nullptr)
+        cache.partial->prev = slab;
+
+    cache.partial = slab;
+    slab->partial = true;
+}
+
+
+void SlabAllocator::UnlinkPartial(SizeCache& cache, Slab* const slab) noexcept
+{
+    assert(slab->partial);
+
+    if (slab->prev != nullptr)
+        slab->prev->next = slab->next;
+    else
+        cache.partial = slab->next;
+
+    if (slab->next != nullptr)
+        slab->next->prev = slab->prev;
+
+    slab->next = nullptr;
+    slab->prev = nullptr;
+    slab->partial = false;
+}
+
+
+SlabAllocator::Slab* SlabAllocator::FindSlab(const void* const ptr) const noexcept
+{
+    const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(ptr);
+    const std::size_t page = (address - m_pageBase) / kPageSize;
+
+    if (address < m_pageBase || page >= m_numPages || m_pageMap[page] == 0)
+        return nullptr;
+
+    Slab* slab = reinterpret_cast<Slab*>(m_pageBase + (m_pageMap[page] - 1u) * kPageSize);
+    const SizeCache& cache = m_caches[slab->sizeClass];
+
+    // The last page of a slab may also hold the start of the next backing allocation
+    const std::uintptr_t objectsStart = reinterpret_cast<std::uintptr_t>(slab) + cache.objectsOffset;
+    if (address < objectsStart || address >= objectsStart + static_cast<std::size_t>(cache.capacity) * cache.objectSize)
+        return nullptr;
+
+    return slab;
+}
+
+
+std::uint64_t* SlabAllocator::FreeMapOf(Slab* const slab) const noexcept
+{
+    return reinterpret_cast<std::uint64_t*>(reinterpret_cast<std::uintptr_t>(slab) + sizeof(Slab));
+}
+
+
+// Room for the new entry is made by the caller beforehand, so this does not throw in practice
+void SlabAllocator::InsertLarge(const void* const ptr)
+{
+    if ((m_largeCount + 1u) * 2u > m_largeCapacity)
+        GrowLargeTable();
+
+    const std::size_t mask = m_largeCapacity - 1u;
+    std::size_t slot = LargeHomeOf(ptr);
+
+    while (m_largeTable[slot] != nullptr)
+        slot = (slot + 1u) & mask;
+
+    m_largeTable[slot] = ptr;
+    ++m_largeCount;
+}
+
+
+void SlabAllocator::EraseLarge(const void* const ptr) noexcept
+{
+    assert(m_largeCapacity != 0);
+
+    const std::size_t mask = m_largeCapacity - 1u;
+    std::size_t hole = LargeHomeOf(ptr);
+
+    while (m_largeTable[hole] != ptr)
+    {
+        assert(m_largeTable[hole] != nullptr);
+        hole = (hole + 1u) & mask;
+    }
+
+    // Entries behind the hole whose home lies outside (hole, slot] move back into it
+    for (std::size_t slot = (hole + 1u) & mask; m_largeTable[slot] != nullptr; slot = (slot + 1u) & mask)
+    {
+        const std::size_t home = LargeHomeOf(m_largeTable[slot]);
+        if (((slot - home) & mask) >= ((slot - hole) & mask))
+        {
+            m_largeTable[hole] = m_largeTable[slot];
+            hole = slot;
+        }
+    }
+
+    m_largeTable[hole] = nullptr;
+    --m_largeCount;
+}
+
+
+bool SlabAllocator::ContainsLarge(const void* const ptr) const noexcept
+{
+    if (m_largeCount == 0)
+        return false;
+
+    const std::size_t mask = m_largeCapacity - 1u;
+
+    for (std::size_t slot = LargeHomeOf(ptr); m_largeTable[slot] != nullptr; slot = (slot + 1u) & mask)
+    {
+        if (m_largeTable[slot] == ptr)
+            return true;
+    }
+
+    return false;
+}
+
+
+std::size_t SlabAllocator::LargeHomeOf(const void* const ptr) const noexcept
+{
+    // Backing blocks are 8-byte aligned, the multiplication spreads the remaining bits
+    const std::uint64_t key = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(ptr) >> 3);
+    return static_cast<std::size_t>((key * 0x9E3779B97F4A7C15ull) >> 32) & (m_largeCapacity - 1u);
+}
+
+
+void SlabAllocator::GrowLargeTable()
+{
+    const std::size_t oldCapacity = m_largeCapacity;
+    const void** oldTable = m_largeTable;
+
+    const std::size_t newCapacity = oldCapacity != 0 ? oldCapacity * 2u : 16u;
+    const void** newTable = static_cast<const void**>(m_backing.Allocate(newCapacity * sizeof(const void*), alignof(const void*)));
+    for (std::size_t i = 0; i < newCapacity; ++i)
+        newTable[i] = nullptr;
+
+    m_largeTable = newTable;
+    m_largeCapacity = newCapacity;
+    m_largeCount = 0;
+
+    for (std::size_t i = 0; i < oldCapacity; ++i)
+    {
+        if (oldTable[i] != nullptr)
+            InsertLarge(oldTable[i]);
+    }
+
+    if (oldTable != nullptr)
+        m_backing.Free(oldTable);
+}
@@ -0,0 +1,224 @@
+﻿#pragma once
+#include <new>
+#include <utility>
+#include "StaticAllocator.h"
+
+// LIFO allocator over a caller-provided region.
+// Every allocation is preceded by a small header holding the top before it and its size, so Free
+// of the most recent allocation restores the top exactly. Markers roll back a whole
+// scope at once. m_usedBytes is the offset of the top, headers and padding included.
+// Reallocate of a block below the top moves it and marks the old block released; released blocks
+// stay on the stack, counted in m_numAllocations, until the blocks above them are gone.
+class StackAllocator final : public StaticAllocator<StackAllocator>
+{
+public:
+    struct Marker
+    {
+        std::size_t offset;
+        std::size_t numAllocations;
+        std::size_t lastAllocation;
+    };
+
+    StackAllocator(const std::size_t sizeBytes, void* start) noexcept;
+
+    StackAllocator(const StackAllocator&) = delete;
+    StackAllocator& operator=(const StackAllocator&) = delete;
+
+    StackAllocator(StackAllocator&&) noexcept;
+    StackAllocator& operator=(StackAllocator&&) noexcept;
+
+    ~StackAllocator() noexcept override final; // = default;
+
+    virtual void* Allocate(const std::size_t& size, const std::uintptr_t& alignment = sizeof(std::intptr_t)) override final;
+
+    // ptr must be the most recent allocation still alive
+    virtual void Free(void* const ptr) noexcept override final;
+    using StaticAllocator::Free;
+
+    virtual std::size_t GetAllocationSize(const void* const ptr) const noexcept override final;
+
+    // Only the most recent allocation can change its size
+    virtual bool TryExpandInPlace(void* const ptr, const std::size_t& newSize) noexcept override final;
+    virtual void* Reallocate(void* const ptr, const std::size_t& newSize, const std::uintptr_t& alignment = sizeof(std::intptr_t)) override final;
+
+    Marker GetMarker() const noexcept;
+    void Rewind(const Marker& marker) noexcept;
+
+private:
+    struct AllocationHeader;
+
+    static constexpr std::size_t kNoAllocation = ~std::size_t(0);
+    static constexpr std::size_t kReleased = ~std::size_t(0);      // AllocationHeader::size of a released block
+
+    AllocationHeader* HeaderOf(const void* const ptr) const noexcept;
+    void PopReleased() noexcept;
+
+protected:
+    std::size_t m_lastAllocation;       // offset of the top allocation, kNoAllocation when empty
+};
+
+
+struct StackAllocator::AllocationHeader
+{
+    std::size_t prevTop;
+    std::size_t prevAllocation;
+    std::size_t size;
+};
+
+
+StackAllocator::StackAllocator(const std::size_t sizeBytes, void* start) noexcept
+    :
+    StaticAllocator(sizeBytes, start), m_lastAllocation(kNoAllocation)
+{}
+
+
+StackAllocator::StackAllocator(StackAllocator&& other) noexcept
+    :
+    StaticAllocator(std::move(other)), m_lastAllocation(other.m_lastAllocation)
+{
+    other.m_lastAllocation = kNoAllocation;
+}
+
+
+StackAllocator& StackAllocator::operator=(StackAllocator&& rhs) noexcept
+{
+    if (this != &rhs) {
+        StaticAllocator::operator=(std::move(rhs));
+        m_lastAllocation = rhs.m_lastAllocation;
+        rhs.m_lastAllocation = kNoAllocation;
+    }
+
+    return *this;
+}
+
+
+StackAllocator::~StackAllocator() noexcept
+{}
+
+
+void* StackAllocator::Allocate(const std::size_t& size, const std::uintptr_t& alignment)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1u)) == 0);
+
+    // The header sits right below the returned address
+    const std::uintptr_t top = reinterpret_cast<std::uintptr_t>(m_start) + m_usedBytes;
+    const std::uintptr_t mask = alignment > alignof(AllocationHeader) ? alignment - 1u : alignof(AllocationHeader) - 1u;
+    const std::size_t adjustment = static_cast<std::size_t>(((top + sizeof(AllocationHeader) + mask) & ~mask) - top);
+
+    if (size > m_size - m_usedBytes || adjustment > m_size - m_usedBytes - size)
+        throw std::bad_alloc();
+
+    const std::uintptr_t alignedAddress = top + adjustment;
+
+    AllocationHeader* header = reinterpret_cast<AllocationHeader*>(alignedAddress - sizeof(AllocationHeader));
+    header->prevTop = m_usedBytes;
+    header->prevAllocation = m_lastAllocation;
+    header->size = size;
+
+    m_lastAllocation = m_usedBytes + adjustment;
+    m_usedBytes += adjustment + size;
+    ++m_numAllocations;
+
+    return reinterpret_cast<void*>(alignedAddress);
+}
+
+
+void StackAllocator::Free(void* const ptr) noexcept
+{
+    assert(ptr != nullptr);
+    assert(reinterpret_cast<std::uintptr_t>(ptr) - reinterpret_cast<std::uintptr_t>(m_start) == m_lastAllocation);
+
+    const AllocationHeader* header = HeaderOf(ptr);
+
+    m_usedBytes = header->prevTop;
+    m_lastAllocation = header->prevAllocation;
+    --m_numAllocations;
+
+    PopReleased();
+}
+
+
+// Any live block, the header keeps its size
+std::size_t StackAllocator::GetAllocationSize(const void* const ptr) const noexcept
+{
+    assert(ptr != nullptr);
+
+    const AllocationHeader* header = HeaderOf(ptr);
+    assert(header->size != kReleased);
+
+    return header->size;
+}
+
+
+bool StackAllocator::TryExpandInPlace(void* const ptr, const std::size_t& newSize) noexcept
+{
+    assert(ptr != nullptr);
+
+    if (reinterpret_cast<std::uintptr_t>(ptr) - reinterpret_cast<std::uintptr_t>(m_start) != m_lastAllocation ||
+        newSize > m_size - m_lastAllocation)
+        return false;
+
+    HeaderOf(ptr)->size = newSize;
+    m_usedBytes = m_lastAllocation + newSize;
+    return true;
+}
+
+
+// A block below the top cannot be freed yet, the copy goes on top and the old block is released
+void* StackAllocator::Reallocate(void* const ptr, const std::size_t& newSize, const std::uintptr_t& alignment)
+{
+    if (ptr == nullptr)
+        return Allocate(newSize, alignment);
+
+    if (TryExpandInPlace(ptr, newSize))
+        return ptr;
+
+    AllocationHeader* header = HeaderOf(ptr);
+    const std::size_t oldSize = header->size;
+    void* newPtr = Allocate(newSize, alignment);
+
+    std::memcpy(newPtr, ptr, oldSize < newSize ? oldSize : newSize);
+
+    header->size = kReleased;
+    return newPtr;
+}
+
+
+StackAllocator::Marker StackAllocator::GetMarker() const noexcept
+{
+    return Marker{ m_usedBytes, m_numAllocations, m_lastAllocation };
+}
+
+
+void StackAllocator::Rewind(const Marker& marker) noexcept
+{
+    assert(marker.offset <= m_usedBytes && marker.numAllocations <= m_numAllocations);
+
+    m_usedBytes = marker.offset;
+    m_numAllocations = marker.numAllocations;
+    m_lastAllocation = marker.lastAllocation;
+
+    PopReleased();
+}
+
+
+StackAllocator::AllocationHeader* StackAllocator::HeaderOf(const void* const ptr) const noexcept
+{
+    return reinterpret_cast<AllocationHeader*>(reinterpret_cast<std::uintptr_t>(ptr) - sizeof(AllocationHeader));
+}
+
+
+// Released blocks that became the top go as well
+void StackAllocator::PopReleased() noexcept
+{
+    while (m_lastAllocation != kNoAllocation)
+    {
+        const AllocationHeader* header = HeaderOf(reinterpret_cast<void*>(reinterpret_cast<std::uintptr_t>(m_start) + m_lastAllocation));
+        if (header->size != kReleased)
+            break;
+
+        m_usedBytes = header->prevTop;
+        m_lastAllocation = header->prevAllocation;
+        --m_numAllocations;
+    }
+}
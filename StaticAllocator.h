@@ -0,0 +1,70 @@
+﻿#pragma once
+#include <type_traits>
+#include "FixedAllocator.h"
+
+// CRTP layer between Allocator and a concrete allocator: class X final : public StaticAllocator<X>.
+// Allocator implements its defaults on top of its own virtuals, so even with the concrete type
+// known every sized Free or Reallocate made one more trip through the vtable. Here the same
+// defaults run on Derived, which must be final, so every call binds at compile time and the
+// fast path inlines into STLAdaptor<T, Derived>. Allocator stays the type-erased interface.
+template<typename Derived, typename Base = FixedAllocator>
+class StaticAllocator : public Base
+{
+public:
+    using Base::Base;
+    using Base::Free;
+
+    virtual void Free(void* const ptr, const std::size_t& size) noexcept override;
+    virtual bool TryExpandInPlace(void* const ptr, const std::size_t& newSize) noexcept override;
+    virtual void* Reallocate(void* const ptr, const std::size_t& newSize, const std::uintptr_t& alignment = sizeof(std::intptr_t)) override;
+
+    virtual void AllocateBatch(const std::size_t& count, const std::size_t& size, const std::uintptr_t& alignment, void** out) override;
+    virtual void FreeBatch(void* const* ptrs, const std::size_t& count) noexcept override;
+
+private:
+    Derived& Self() noexcept;
+};
+
+
+template<typename Derived, typename Base>
+void StaticAllocator<Derived, Base>::Free(void* const ptr, const std::size_t& size) noexcept
+{
+    Allocator::DefaultFree(Self(), ptr, size);
+}
+
+
+template<typename Derived, typename Base>
+bool StaticAllocator<Derived, Base>::TryExpandInPlace(void* const ptr, const std::size_t& newSize) noexcept
+{
+    return Allocator::DefaultTryExpandInPlace(Self(), ptr, newSize);
+}
+
+
+template<typename Derived, typename Base>
+void* StaticAllocator<Derived, Base>::Reallocate(void* const ptr, const std::size_t& newSize, const std::uintptr_t& alignment)
+{
+    return Allocator::DefaultReallocate(Self(), ptr, newSize, alignment);
+}
+
+
+template<typename Derived, typename Base>
+void StaticAllocator<Derived, Base>::AllocateBatch(const std::size_t& count, const std::size_t& size, const std::uintptr_t& alignment,
+    void** out)
+{
+    Allocator::DefaultAllocateBatch(Self(), count, size, alignment, out);
+}
+
+
+template<typename Derived, typename Base>
+void StaticAllocator<Derived, Base>::FreeBatch(void* const* ptrs, const std::size_t& count) noexcept
+{
+    Allocator::DefaultFreeBatch(Self(), ptrs, count);
+}
+
+
+template<typename Derived, typename Base>
+Derived& StaticAllocator<Derived, Base>::Self() noexcept
+{
+    static_assert(std::is_final_v<Derived>, "calls through Derived only bind statically when it is final");
+    return static_cast<Derived&>(*this);
+}
@@ -0,0 +1,384 @@
+﻿#pragma once
+#include <new>
+#include "StaticAllocator.h"
+#include "BitOperations.h"
+
+// Two-Level Segregated Fit allocator.
+// Free blocks are kept in a matrix of lists indexed by (first level = power of two,
+// second level = linear subdivision of that power of two). Two bitmaps locate a
+// non-empty list, so Allocate and Free run in constant time regardless of fragmentation.
+class TLSFAllocator final : public StaticAllocator<TLSFAllocator>
+{
+public:
+    TLSFAllocator(const std::size_t sizeBytes, void* start) noexcept;
+
+    TLSFAllocator(const TLSFAllocator&) = delete;
+    TLSFAllocator& operator=(const TLSFAllocator&) = delete;
+
+    TLSFAllocator(TLSFAllocator&&) noexcept;
+    TLSFAllocator& operator=(TLSFAllocator&&) noexcept;
+
+    ~TLSFAllocator() noexcept override final;
+
+    virtual void* Allocate(const std::size_t& size, const std::uintptr_t& alignment = sizeof(std::intptr_t)) override final;
+    virtual void Free(void* const ptr) noexcept override final;
+    using StaticAllocator::Free;
+
+    virtual std::size_t GetAllocationSize(const void* const ptr) const noexcept override final;
+
+private:
+    struct BlockHeader;
+
+    static constexpr std::size_t kAlignShift = 4;
+    static constexpr std::size_t kAlignment = std::size_t(1) << kAlignShift;    // granularity of block sizes and payloads
+    static constexpr std::size_t kSLLog2 = 4;
+    static constexpr std::size_t kSLCount = std::size_t(1) << kSLLog2;          // second-level lists per first level
+    static constexpr std::size_t kFLShift = kSLLog2 + kAlignShift;              // sizes below 2^kFLShift share first level 0
+    static constexpr std::size_t kFLMax = 40;                                   // largest manageable block is below 2^kFLMax
+    static constexpr std::size_t kFLCount = kFLMax - kFLShift + 1;
+
+    static constexpr std::size_t kBlockOverhead = sizeof(void*) + sizeof(std::size_t);   // bytes before the payload
+    static constexpr std::size_t kFreeBit = 1;
+
+    static void MappingInsert(const std::size_t& size, std::size_t& fl, std::size_t& sl) noexcept;
+    static void MappingSearch(const std::size_t& size, std::size_t& fl, std::size_t& sl) noexcept;
+
+    static std::size_t BlockSize(const BlockHeader* block) noexcept;
+    static bool IsFree(const BlockHeader* block) noexcept;
+
+    BlockHeader* NextPhysical(const BlockHeader* block) const noexcept;
+    BlockHeader* FindSuitableBlock(std::size_t& fl, std::size_t& sl) const noexcept;
+    BlockHeader* SplitBlock(BlockHeader* block, const std::size_t& size) noexcept;
+
+    void InsertFreeBlock(BlockHeader* block) noexcept;
+    void RemoveFreeBlock(BlockHeader* block) noexcept;
+
+protected:
+    std::uintptr_t m_poolStart;
+    std::uintptr_t m_poolEnd;
+
+    std::uint64_t m_flBitmap;
+    std::uint64_t m_slBitmap[kFLCount];
+    BlockHeader* m_blocks[kFLCount][kSLCount];
+};
+
+
+// prevPhysical and size precede every payload, nextFree/prevFree overlap the payload of free blocks
+struct TLSFAllocator::BlockHeader {
+    BlockHeader* prevPhysical;
+    std::size_t size;           // whole block including this header, low bit is kFreeBit
+    BlockHeader* nextFree;
+    BlockHeader* prevFree;
+};
+
+
+TLSFAllocator::TLSFAllocator(const std::size_t sizeBytes, void* start) noexcept
+    :
+    StaticAllocator(sizeBytes, start),
+    m_poolStart(0), m_poolEnd(0),
+    m_flBitmap(0), m_slBitmap{}, m_blocks{}
+{
+    const std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(start);
+    m_poolStart = (begin + kAlignment - 1u) & ~(kAlignment - 1u);
+    m_poolEnd = (begin + sizeBytes) & ~(kAlignment - 1u);
+
+    assert(m_poolEnd > m_poolStart && m_poolEnd - m_poolStart >= sizeof(BlockHeader));
+    assert(m_poolEnd - m_poolStart < (std::size_t(1) << kFLMax));
+
+    BlockHeader* block = reinterpret_cast<BlockHeader*>(m_poolStart);
+    block->prevPhysical = nullptr;
+    block->size = (m_poolEnd - m_poolStart) | kFreeBit;
+    InsertFreeBlock(block);
+}
+
+
+TLSFAllocator::TLSFAllocator(TLSFAllocator&& other) noexcept
+    :
+    StaticAllocator(std::move(other)),
+    m_poolStart(other.m_poolStart), m_poolEnd(other.m_poolEnd),
+    m_flBitmap(other.m_flBitmap)
+{
+    for (std::size_t fl = 0; fl < kFLCount; ++fl)
+    {
+        m_slBitmap[fl] = other.m_slBitmap[fl];
+        other.m_slBitmap[fl] = 0;
+
+        for (std::size_t sl = 0; sl < kSLCount; ++sl)
+        {
+            m_blocks[fl][sl] = other.m_blocks[fl][sl];
+            other.m_blocks[fl][sl] = nullptr;
+        }
+    }
+
+    other.m_poolStart = 0;
+    other.m_poolEnd = 0;
+    other.m_flBitmap = 0;
+}
+
+
+TLSFAllocator& TLSFAllocator::operator=(TLSFAllocator&& rhs) noexcept
+{
+    if (this != &rhs) {
+        Allocator::operator=(std::move(rhs));
+        m_poolStart = rhs.m_poolStart;
+        m_poolEnd = rhs.m_poolEnd;
+        m_flBitmap = rhs.m_flBitmap;
+
+        for (std::size_t fl = 0; fl < kFLCount; ++fl)
+        {
+            m_slBitmap[fl] = rhs.m_slBitmap[fl];
+            rhs.m_slBitmap[fl] = 0;
+
+            for (std::size_t sl = 0; sl < kSLCount; ++sl)
+            {
+                m_blocks[fl][sl] = rhs.m_blocks[fl][sl];
+                rhs.m_blocks[fl][sl] = nullptr;
+            }
+        }
+
+        rhs.m_poolStart = 0;
+        rhs.m_poolEnd = 0;
+        rhs.m_flBitmap = 0;
+    }
+
+    return *this;
+}
+
+
+TLSFAllocator::~TLSFAllocator() noexcept
+{
+    assert(m_numAllocations == 0 && m_usedBytes == 0);
+}
+
+
+void* TLSFAllocator::Allocate(const std::size_t& size, const std::uintptr_t& alignment)
+{
+    assert(alignment != 0 && (alignment & (alignment - 1u)) == 0);
+
+    std::size_t payload = (size + kAlignment - 1u) & ~(kAlignment - 1u);
+    if (payload < sizeof(BlockHeader) - kBlockOverhead)
+        payload = sizeof(BlockHeader) - kBlockOverhead;
+
+    const std::size_t blockSize = payload + kBlockOverhead;
+
+    // Over-aligned requests reserve room for a leading free block that is split off afterwards
+    std::size_t searchSize = blockSize;
+    if (alignment > kAlignment)
+        searchSize += alignment + sizeof(BlockHeader);
+
+    if (size > searchSize || searchSize >= (std::size_t(1) << kFLMax))
+        throw std::bad_alloc();
+
+    std::size_t fl, sl;
+    MappingSearch(searchSize, fl, sl);
+
+    BlockHeader* block = fl < kFLCount ? FindSuitableBlock(fl, sl) : nullptr;
+    if (block == nullptr)
+        throw std::bad_alloc();
+
+    RemoveFreeBlock(block);
+
+    if (alignment > kAlignment)
+    {
+        const std::uintptr_t payloadAddr = reinterpret_cast<std::uintptr_t>(block) + kBlockOverhead;
+        std::uintptr_t alignedAddr = (payloadAddr + alignment - 1u) & ~(alignment - 1u);
+
+        // A gap too small to be a block of its own is pushed to the next aligned address
+        if (alignedAddr != payloadAddr && alignedAddr - payloadAddr < sizeof(BlockHeader))
+            alignedAddr = (payloadAddr + sizeof(BlockHeader) + alignment - 1u) & ~(alignment - 1u);
+
+        const std::size_t gap = alignedAddr - payloadAddr;
+        if (gap != 0)
+        {
+            BlockHeader* aligned = SplitBlock(block, gap);
+            InsertFreeBlock(block);
+            block = aligned;
+        }
+    }
+
+    if (BlockSize(block) >= blockSize + sizeof(BlockHeader))
+    {
+        BlockHeader* remainder = SplitBlock(block, blockSize);
+        InsertFreeBlock(remainder);
+    }
+
+    block->size &= ~kFreeBit;
+
+    m_usedBytes += BlockSize(block);
+    ++m_numAllocations;
+
+    return reinterpret_cast<void*>(reinterpret_cast<std::uintptr_t>(block) + kBlockOverhead);
+}
+
+
+void TLSFAllocator::Free(void* const ptr) noexcept
+{
+    assert(ptr != nullptr);
+
+    BlockHeader* block = reinterpret_cast<BlockHeader*>(reinterpret_cast<std::uintptr_t>(ptr) - kBlockOverhead);
+    assert(!IsFree(block));
+
+    m_usedBytes -= BlockSize(block);
+    --m_numAllocations;
+
+    block->size |= kFreeBit;
+
+    BlockHeader* prev = block->prevPhysical;
+    if (prev != nullptr && IsFree(prev))
+    {
+        RemoveFreeBlock(prev);
+        prev->size += BlockSize(block);
+        block = prev;
+    }
+
+    BlockHeader* next = NextPhysical(block);
+    if (next != nullptr && IsFree(next))
+    {
+        RemoveFreeBlock(next);
+        block->size += BlockSize(next);
+    }
+
+    next = NextPhysical(block);
+    if (next != nullptr)
+        next->prevPhysical = block;
+
+    InsertFreeBlock(block);
+}
+
+
+std::size_t TLSFAllocator::GetAllocationSize(const void* const ptr) const noexcept
+{
+    assert(ptr != nullptr);
+
+    const BlockHeader* block = reinterpret_cast<const BlockHeader*>(reinterpret_cast<std::uintptr_t>(ptr) - kBlockOverhead);
+    assert(!IsFree(block));
+
+    return BlockSize(block) - kBlockOverhead;
+}
+
+
+void TLSFAllocator::MappingInsert(const std::size_t& size, std::size_t& fl, std::size_t& sl) noexcept
+{
+    if (size < (std::size_t(1) << kFLShift))
+    {
+        fl = 0;
+        sl = size >> kAlignShift;
+    }
+    else
+    {
+        const std::size_t highBit = FindHighestSetBit(size);
+        sl = (size >> (highBit - kSLLog2)) ^ kSLCount;
+        fl = highBit - kFLShift + 1u;
+    }
+}
+
+
+// Rounds the size up to the next list boundary, so any block found there is large enough
+void TLSFAllocator::MappingSearch(const std::size_t& size, std::size_t& fl, std::size_t& sl) noexcept
+{
+    std::size_t rounded = size;
+
+    if (size >= (std::size_t(1) << kFLShift))
+        rounded += (std::size_t(1) << (FindHighestSetBit(size) - kSLLog2)) - 1u;
+
+    MappingInsert(rounded, fl, sl);
+}
+
+
+std::size_t TLSFAllocator::BlockSize(const BlockHeader* block) noexcept
+{
+    return block->size & ~kFreeBit;
+}
+
+
+bool TLSFAllocator::IsFree(const BlockHeader* block) noexcept
+{
+    return (block->size & kFreeBit) != 0;
+}
+
+
+TLSFAllocator::BlockHeader* TLSFAllocator::NextPhysical(const BlockHeader* block) const noexcept
+{
+    const std::uintptr_t next = reinterpret_cast<std::uintptr_t>(block) + BlockSize(block);
+    return next < m_poolEnd ? reinterpret_cast<BlockHeader*>(next) : nullptr;
+}
+
+
+TLSFAllocator::BlockHeader* TLSFAllocator::FindSuitableBlock(std::size_t& fl, std::size_t& sl) const noexcept
+{
+    std::uint64_t slMap = m_slBitmap[fl] & (~std::uint64_t(0) << sl);
+
+    if (slMap == 0)
+    {
+        const std::uint64_t flMap = fl + 1u < 64u ? m_flBitmap & (~std::uint64_t(0) << (fl + 1u)) : 0;
+        if (flMap == 0)
+            return nullptr;
+
+        fl = FindLowestSetBit(flMap);
+        slMap = m_slBitmap[fl];
+    }
+
+    sl = FindLowestSetBit(slMap);
+    return m_blocks[fl][sl];
+}
+
+
+// Cuts block at offset size, the tail inherits the free bit, returns the tail
+TLSFAllocator::BlockHeader* TLSFAllocator::SplitBlock(BlockHeader* block, const std::size_t& size) noexcept
+{
+    const std::size_t blockSize = BlockSize(block);
+    assert(size >= sizeof(BlockHeader) && blockSize >= size + sizeof(BlockHeader));
+
+    BlockHeader* tail = reinterpret_cast<BlockHeader*>(reinterpret_cast<std::uintptr_t>(block) + size);
+    tail->prevPhysical = block;
+    tail->size = (blockSize - size) | (block->size & kFreeBit);
+
+    block->size = size | (block->size & kFreeBit);
+
+    BlockHeader* next = NextPhysical(tail);
+    if (next != nullptr)
+        next->prevPhysical = tail;
+
+    return tail;
+}
+
+
+void TLSFAllocator::InsertFreeBlock(BlockHeader* block) noexcept
+{
+    std::size_t fl, sl;
+    MappingInsert(BlockSize(block), fl, sl);
+
+    block->size |= kFreeBit;
+    block->prevFree = nullptr;
+    block->nextFree = m_blocks[fl][sl];
+
+    if (block->nextFree != nullptr)
+        block->nextFree->prevFree = block;
+
+    m_blocks[fl][sl] = block;
+    m_slBitmap[fl] |= std::uint64_t(1) << sl;
+    m_flBitmap |= std::uint64_t(1) << fl;
+}
+
+
+void TLSFAllocator::RemoveFreeBlock(BlockHeader* block) noexcept
+{
+    std::size_t fl, sl;
+    MappingInsert(BlockSize(block), fl, sl);
+
+    if (block->prevFree != nullptr)
+        block->prevFree->nextFree = block->nextFree;
+    else
+        m_blocks[fl][sl] = block->nextFree;
+
+    if (block->nextFree != nullptr)
+        block->nextFree->prevFree = block->prevFree;
+
+    if (m_blocks[fl][sl] == nullptr)
+    {
+        m_slBitmap[fl] &= ~(std::uint64_t(1) << sl);
+
+        if (m_slBitmap[fl] == 0)
+            m_flBitmap &= ~(std::uint64_t(1) << fl);
+    }
+}
@@ -0,0 +1,280 @@
+﻿#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <new>
+#include <thread>
+#include "AllocationTrace.h"
+
+// 16 bytes at the start of the file
+struct TraceFileHeader
+{
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t recordSize;
+    std::uint32_t reserved;
+};
+
+
+// 40 bytes per event, little-endian as written by the host
+struct TraceRecord
+{
+    std::uint64_t timestamp;        // nanoseconds since TraceRecorder::Start
+    std::uint64_t address;
+    std::uint64_t size;
+    std::uint64_t caller;
+    std::uint32_t alignment;
+    std::uint16_t thread;           // ring index, stable while the thread lives
+    std::uint8_t op;                // TraceOp
+    std::uint8_t reserved;
+};
+
+
+// Trace sink for production: every event goes to a lock-free ring of the calling thread and a
+// background drainer appends the rings to a binary file, so a traced call does no I/O and takes no lock.
+// A ring has one producer, its thread, and one consumer, the drainer. When a ring is full the event
+// is dropped and counted rather than blocking the allocator. Rings are never freed, a thread that
+// exits hands its ring over to the next thread that starts recording.
+//
+// File layout: a TraceFileHeader followed by TraceRecords, in drain order. Records of one thread
+// are in time order, records of different threads are not; sort by timestamp to merge them.
+//
+//     TraceRecorder::Start("allocations.trace");
+//     ...                            // calls to BasicFreeListAllocator<FreeListPolicies<..., TraceRecorder>>
+//     TraceRecorder::Stop();         // before the program exits
+class TraceRecorder
+{
+public:
+    static constexpr char kMagic[4] = { 'F', 'L', 'T', 'R' };
+    static constexpr std::uint32_t kVersion = 1;
+    static constexpr std::size_t kRingCapacity = 8192;         // records per thread, a power of two
+
+    // Starts recording to a new file at path, false when the file cannot be created or a recording runs
+    static bool Start(const char* path, const std::chrono::milliseconds& drainInterval = std::chrono::milliseconds(10));
+
+    // Drains what is left, closes the file. Events recorded after Stop returns are discarded
+    static void Stop() noexcept;
+
+    static void Record(const TraceEvent& event) noexcept;
+
+    static bool IsRecording() noexcept;
+    static std::uint64_t GetDroppedCount() noexcept;
+
+private:
+    struct Ring;
+    struct RingLease;
+
+    static Ring* AcquireRing() noexcept;
+    static Ring* ThreadRing() noexcept;
+
+    static void DrainLoop(const std::chrono::milliseconds drainInterval) noexcept;
+    static void DrainRings() noexcept;
+
+    inline static std::atomic<bool> s_recording{ false };
+    inline static std::atomic<Ring*> s_rings{ nullptr };
+    inline static std::atomic<std::uint16_t> s_numRings{ 0 };
+    inline static std::atomic<std::uint64_t> s_dropped{ 0 };
+    inline static std::chrono::steady_clock::time_point s_epoch;
+
+    inline static std::FILE* s_file = nullptr;
+    inline static std::thread s_drainer;
+    inline static std::mutex s_mutex;                   // guards Start, Stop and the wakeup of the drainer
+    inline static std::condition_variable s_wakeup;
+    inline static bool s_stopRequested = false;
+};
+
+
+struct TraceRecorder::Ring {
+    TraceRecord records[kRingCapacity];
+    std::atomic<std::uint64_t> head{ 0 };       // next record to write, advanced by the owning thread
+    std::atomic<std::uint64_t> tail{ 0 };       // next record to drain, advanced by the drainer
+    std::atomic<bool> owned{ false };
+    std::uint16_t thread = 0;
+    Ring* next = nullptr;
+};
+
+
+// Releases the ring of a thread when the thread exits
+struct TraceRecorder::RingLease {
+    Ring* ring = nullptr;
+
+    ~RingLease()
+    {
+        if (ring != nullptr)
+            ring->owned.store(false, std::memory_order_release);
+    }
+};
+
+
+bool TraceRecorder::Start(const char* path, const std::chrono::milliseconds& drainInterval)
+{
+    std::lock_guard<std::mutex> guard(s_mutex);
+
+    if (s_file != nullptr)
+        return false;
+
+    s_file = std::fopen(path, "wb");
+    if (s_file == nullptr)
+        return false;
+
+    const TraceFileHeader header = { { kMagic[0], kMagic[1], kMagic[2], kMagic[3] }, kVersion, sizeof(TraceRecord), 0 };
+    std::fwrite(&header, sizeof(header), 1, s_file);
+
+    // Leftovers of an earlier recording are not part of this one
+    for (Ring* ring = s_rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next)
+        ring->tail.store(ring->head.load(std::memory_order_acquire), std::memory_order_release);
+
+    s_dropped.store(0, std::memory_order_relaxed);
+    s_epoch = std::chrono::steady_clock::now();
+    s_stopRequested = false;
+    s_drainer = std::thread(DrainLoop, drainInterval);
+
+    s_recording.store(true, std::memory_order_release);
+    return true;
+}
+
+
+void TraceRecorder::Stop() noexcept
+{
+    {
+        std::lock_guard<std::mutex> guard(s_mutex);
+
+        if (s_file == nullptr)
+            return;
+
+        s_recording.store(false, std::memory_order_release);
+        s_stopRequested = true;
+    }
+
+    s_wakeup.notify_one();
+    s_drainer.join();
+
+    std::lock_guard<std::mutex> guard(s_mutex);
+
+    std::fclose(s_file);
+    s_file = nullptr;
+}
+
+
+void TraceRecorder::Record(const TraceEvent& event) noexcept
+{
+    if (!s_recording.load(std::memory_order_acquire))
+        return;
+
+    Ring* ring = ThreadRing();
+    if (ring == nullptr)
+    {
+        s_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    const std::uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) == kRingCapacity)
+    {
+        s_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    TraceRecord& record = ring->records[head & (kRingCapacity - 1u)];
+    record.timestamp = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_epoch).count());
+    record.address = reinterpret_cast<std::uintptr_t>(event.address);
+    record.size = event.size;
+    record.caller = reinterpret_cast<std::uintptr_t>(event.caller);
+    record.alignment = static_cast<std::uint32_t>(event.alignment);
+    record.thread = ring->thread;
+    record.op = static_cast<std::uint8_t>(event.op);
+    record.reserved = 0;
+
+    ring->head.store(head + 1u, std::memory_order_release);
+}
+
+
+bool TraceRecorder::IsRecording() noexcept
+{
+    return s_recording.load(std::memory_order_relaxed);
+}
+
+
+std::uint64_t TraceRecorder::GetDroppedCount() noexcept
+{
+    return s_dropped.load(std::memory_order_relaxed);
+}
+
+
+// Takes over the ring of an exited thread, or links a new one; nullptr when out of memory
+TraceRecorder::Ring* TraceRecorder::AcquireRing() noexcept
+{
+    for (Ring* ring = s_rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next)
+    {
+        bool owned = false;
+        if (ring->owned.compare_exchange_strong(owned, true, std::memory_order_acquire))
+            return ring;
+    }
+
+    Ring* ring = new (std::nothrow) Ring();
+    if (ring == nullptr)
+        return nullptr;
+
+    ring->owned.store(true, std::memory_order_relaxed);
+    ring->thread = s_numRings.fetch_add(1, std::memory_order_relaxed);
+    ring->next = s_rings.load(std::memory_order_relaxed);
+
+    while (!s_rings.compare_exchange_weak(ring->next, ring, std::memory_order_release, std::memory_order_relaxed))
+        ;
+
+    return ring;
+}
+
+
+TraceRecorder::Ring* TraceRecorder::ThreadRing() noexcept
+{
+    thread_local RingLease lease;
+
+    if (lease.ring == nullptr)
+        lease.ring = AcquireRing();
+
+    return lease.ring;
+}
+
+
+void TraceRecorder::DrainLoop(const std::chrono::milliseconds drainInterval) noexcept
+{
+    for (;;)
+    {
+        bool stop;
+        {
+            std::unique_lock<std::mutex> lock(s_mutex);
+            s_wakeup.wait_for(lock, drainInterval, [] { return s_stopRequested; });
+            stop = s_stopRequested;
+        }
+
+        DrainRings();
+
+        if (stop)
+            return;
+    }
+}
+
+
+// Only the drainer advances tail, so the records between tail and head stay put while they are written
+void TraceRecorder::DrainRings() noexcept
+{
+    for (Ring* ring = s_rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next)
+    {
+        const std::uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        const std::uint64_t head = ring->head.load(std::memory_order_acquire);
+
+        // At most two runs, the second one starts over at the beginning of the ring
+        const std::size_t first = static_cast<std::size_t>(tail & (kRingCapacity - 1u));
+        const std::size_t count = static_cast<std::size_t>(head - tail);
+        const std::size_t firstRun = count < kRingCapacity - first ? count : kRingCapacity - first;
+
+        std::fwrite(ring->records + first, sizeof(TraceRecord), firstRun, s_file);
+        std::fwrite(ring->records, sizeof(TraceRecord), count - firstRun, s_file);
+
+        ring->tail.store(head, std::memory_order_release);
+    }
+}
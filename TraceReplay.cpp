@@ -0,0 +1,478 @@
+﻿#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "AllocatorBaselines.h"
+#include "FreeListAllocatorCustom.h"
+#include "TLSFAllocator.h"
+#include "BuddyAllocator.h"
+#include "TraceRecorder.h"
+
+// Replays a trace written by TraceRecorder against several allocators and compares them.
+//
+//     TraceReplay <trace file> [--arena <MiB>] [--engine <name>]...
+//
+// The records of all threads are merged by timestamp and replayed on one thread, so the
+// results compare the allocators, not the locking. Addresses only identify an allocation
+// within the recording: every Allocate opens a lifetime, the next Free of that address closes it.
+// Each engine runs the trace twice on a fresh arena: once for throughput, once with a clock
+// around every call for the latency percentiles and the memory figures.
+
+enum class ReplayKind : std::uint8_t
+{
+    Allocate,
+    Free
+};
+
+struct ReplayOp
+{
+    ReplayKind kind;
+    std::uint32_t id;           // lifetime, index into ReplayTrace::objects
+};
+
+struct ReplayObject
+{
+    std::size_t size;
+    std::uintptr_t alignment;
+};
+
+struct ReplayTrace
+{
+    std::vector<ReplayOp> ops;
+    std::vector<ReplayObject> objects;
+
+    std::size_t numRecords = 0;
+    std::size_t numThreads = 0;
+    std::size_t unmatchedFrees = 0;         // frees of allocations made before the recording started
+    std::size_t lostFrees = 0;              // address handed out again before its free, the free was dropped
+    std::size_t peakRequested = 0;
+};
+
+struct Percentiles
+{
+    std::uint64_t p50 = 0;
+    std::uint64_t p99 = 0;
+    std::uint64_t p999 = 0;
+    std::uint64_t max = 0;
+};
+
+struct ReplayResult
+{
+    bool outOfMemory = false;
+    std::size_t failedOp = 0;
+
+    double opsPerSecond = 0.0;
+    Percentiles allocateNs;
+    Percentiles freeNs;
+
+    std::size_t peakUsed = 0;           // GetUsed of the allocator, 0 when it has none
+    std::size_t touched = 0;            // address range between the lowest and the highest allocated byte
+};
+
+
+static const char* const kEngineNames[] = {
+    "freelist", "freelist-segregated", "freelist-indexed", "tlsf", "buddy", "new-delete", "pmr-pool"
+};
+
+static const char* const kUsage =
+    "usage: TraceReplay <trace file> [--arena <MiB>] [--engine <name>]...\n"
+    "engines: freelist freelist-segregated freelist-indexed tlsf buddy new-delete pmr-pool\n";
+
+
+// The allocators of this repository take the size of the request, the baselines the alignment as well
+template<typename Engine>
+static void FreeObject(Engine& engine, void* const ptr, const ReplayObject& object) noexcept
+{
+    if constexpr (std::is_base_of_v<Allocator, Engine>)
+        engine.Free(ptr, object.size);
+    else
+        engine.Free(ptr, object.size, object.alignment);
+}
+
+
+template<typename Engine>
+static std::size_t UsedBytes(const Engine& engine) noexcept
+{
+    if constexpr (std::is_base_of_v<Allocator, Engine>)
+        return engine.GetUsed();
+    else
+        return 0;
+}
+
+
+static bool ReadTrace(const char* path, ReplayTrace& trace)
+{
+    std::FILE* file = std::fopen(path, "rb");
+    if (file == nullptr)
+    {
+        std::fprintf(stderr, "cannot open %s\n", path);
+        return false;
+    }
+
+    TraceFileHeader header;
+    if (std::fread(&header, sizeof(header), 1, file) != 1 || std::memcmp(header.magic, TraceRecorder::kMagic, 4) != 0
+        || header.version != TraceRecorder::kVersion || header.recordSize != sizeof(TraceRecord))
+    {
+        std::fprintf(stderr, "%s is not a trace of this version\n", path);
+        std::fclose(file);
+        return false;
+    }
+
+    std::vector<TraceRecord> records;
+    TraceRecord record;
+
+    while (std::fread(&record, sizeof(record), 1, file) == 1)
+        records.push_back(record);
+
+    std::fclose(file);
+
+    // The file is in drain order, each thread in time order
+    std::stable_sort(records.begin(), records.end(),
+        [](const TraceRecord& a, const TraceRecord& b) { return a.timestamp < b.timestamp; });
+
+    std::unordered_map<std::uint64_t, std::uint32_t> live;
+    std::size_t requested = 0;
+    std::uint16_t maxThread = 0;
+
+    trace.numRecords = records.size();
+
+    for (const TraceRecord& r : records)
+    {
+        maxThread = std::max(maxThread, r.thread);
+
+        if (r.op == static_cast<std::uint8_t>(TraceOp::Allocate))
+        {
+            const auto found = live.find(r.address);
+            if (found != live.end())
+            {
+                ++trace.lostFrees;
+                requested -= trace.objects[found->second].size;
+                trace.ops.push_back({ ReplayKind::Free, found->second });
+                live.erase(found);
+            }
+
+            const bool powerOfTwo = r.alignment != 0 && (r.alignment & (r.alignment - 1u)) == 0;
+            const std::uint32_t id = static_cast<std::uint32_t>(trace.objects.size());
+
+            trace.objects.push_back({ r.size != 0 ? r.size : 1u, powerOfTwo ? r.alignment : sizeof(std::intptr_t) });
+            trace.ops.push_back({ ReplayKind::Allocate, id });
+            live.emplace(r.address, id);
+
+            requested += trace.objects[id].size;
+            trace.peakRequested = std::max(trace.peakRequested, requested);
+        }
+        else if (r.op == static_cast<std::uint8_t>(TraceOp::Free))
+        {
+            const auto found = live.find(r.address);
+            if (found == live.end())
+            {
+                ++trace.unmatchedFrees;
+                continue;
+            }
+
+            requested -= trace.objects[found->second].size;
+            trace.ops.push_back({ ReplayKind::Free, found->second });
+            live.erase(found);
+        }
+    }
+
+    trace.numThreads = records.empty() ? 0 : maxThread + 1u;
+    return true;
+}
+
+
+static Percentiles ComputePercentiles(std::vector<std::uint64_t>& samples)
+{
+    Percentiles result;
+    if (samples.empty())
+        return result;
+
+    std::sort(samples.begin(), samples.end());
+
+    const auto at = [&](const double fraction) {
+        return samples[std::min(samples.size() - 1u, static_cast<std::size_t>(fraction * samples.size()))];
+    };
+
+    result.p50 = at(0.50);
+    result.p99 = at(0.99);
+    result.p999 = at(0.999);
+    result.max = samples.back();
+
+    return result;
+}
+
+
+// Returns the objects still live at the end of the trace, or after a failed Allocate
+template<typename Engine>
+static void ReleaseAll(Engine& engine, const ReplayTrace& trace, std::vector<void*>& slots) noexcept
+{
+    for (std::size_t id = 0; id < slots.size(); ++id)
+    {
+        if (slots[id] != nullptr)
+            FreeObject(engine, slots[id], trace.objects[id]);
+
+        slots[id] = nullptr;
+    }
+}
+
+
+static std::uint64_t ElapsedNs(const std::chrono::steady_clock::time_point& since) noexcept
+{
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count());
+}
+
+
+// One pass over the trace. With measure set every call is timed and the memory figures are tracked
+template<typename Engine>
+static void RunPass(Engine& engine, const ReplayTrace& trace, std::vector<void*>& slots, const bool measure,
+    ReplayResult& result)
+{
+    using Clock = std::chrono::steady_clock;
+
+    std::vector<std::uint64_t> allocateNs;
+    std::vector<std::uint64_t> freeNs;
+
+    if (measure)
+    {
+        allocateNs.reserve(trace.objects.size());
+        freeNs.reserve(trace.objects.size());
+    }
+
+    std::uintptr_t lowest = UINTPTR_MAX;
+    std::uintptr_t highest = 0;
+
+    const Clock::time_point passStart = Clock::now();
+    std::size_t i = 0;
+
+    try
+    {
+        for (; i < trace.ops.size(); ++i)
+        {
+            const ReplayOp& op = trace.ops[i];
+            const ReplayObject& object = trace.objects[op.id];
+
+            if (!measure)
+            {
+                if (op.kind == ReplayKind::Allocate)
+                    slots[op.id] = engine.Allocate(object.size, object.alignment);
+                else
+                {
+                    FreeObject(engine, slots[op.id], object);
+                    slots[op.id] = nullptr;
+                }
+
+                continue;
+            }
+
+            const Clock::time_point before = Clock::now();
+
+            if (op.kind == ReplayKind::Allocate)
+            {
+                slots[op.id] = engine.Allocate(object.size, object.alignment);
+                allocateNs.push_back(ElapsedNs(before));
+
+                result.peakUsed = std::max(result.peakUsed, UsedBytes(engine));
+
+                lowest = std::min(lowest, reinterpret_cast<std::uintptr_t>(slots[op.id]));
+                highest = std::max(highest, reinterpret_cast<std::uintptr_t>(slots[op.id]) + object.size);
+            }
+            else
+            {
+                FreeObject(engine, slots[op.id], object);
+                freeNs.push_back(ElapsedNs(before));
+                slots[op.id] = nullptr;
+            }
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        result.outOfMemory = true;
+        result.failedOp = i;
+    }
+
+    const double seconds = std::chrono::duration<double>(Clock::now() - passStart).count();
+
+    ReleaseAll(engine, trace, slots);
+
+    if (result.outOfMemory)
+        return;
+
+    if (measure)
+    {
+        result.touched = highest > lowest ? highest - lowest : 0;
+        result.allocateNs = ComputePercentiles(allocateNs);
+        result.freeNs = ComputePercentiles(freeNs);
+    }
+    else if (seconds > 0.0)
+        result.opsPerSecond = static_cast<double>(trace.ops.size()) / seconds;
+}
+
+
+// makeEngine builds a fresh engine for each pass, so the latency pass does not start on a warm arena
+template<typename Engine, typename MakeEngine>
+static ReplayResult Replay(const ReplayTrace& trace, MakeEngine&& makeEngine)
+{
+    ReplayResult result;
+    std::vector<void*> slots(trace.objects.size(), nullptr);
+
+    for (const bool measure : { false, true })
+    {
+        Engine& engine = makeEngine();
+        RunPass(engine, trace, slots, measure, result);
+        engine.~Engine();
+
+        if (result.outOfMemory)
+            break;
+    }
+
+    return result;
+}
+
+
+// Engines over a fixed arena are placed in raw storage so one arena serves both passes
+template<typename Alloc, typename... Args>
+static ReplayResult ReplayArena(const ReplayTrace& trace, const std::size_t arenaSize, Args... args)
+{
+    void* arena = ::operator new(arenaSize, std::align_val_t(64));
+    alignas(Alloc) unsigned char storage[sizeof(Alloc)];
+
+    const ReplayResult result = Replay<Alloc>(trace, [&]() -> Alloc& {
+        return *new (storage) Alloc(arenaSize, arena, args...);
+    });
+
+    ::operator delete(arena, std::align_val_t(64));
+    return result;
+}
+
+
+template<typename Baseline>
+static ReplayResult ReplayBaseline(const ReplayTrace& trace)
+{
+    alignas(Baseline) unsigned char storage[sizeof(Baseline)];
+
+    return Replay<Baseline>(trace, [&]() -> Baseline& {
+        return *new (storage) Baseline();
+    });
+}
+
+
+static ReplayResult RunEngine(const std::string& name, const ReplayTrace& trace, const std::size_t arenaSize)
+{
+    using FitPolicy = FreeListAllocator::FitPolicy;
+    using ZeroPolicy = FreeListAllocator::ZeroPolicy;
+
+    if (name == "freelist")
+        return ReplayArena<FreeListAllocator>(trace, arenaSize);
+    if (name == "freelist-segregated")
+        return ReplayArena<FreeListAllocator>(trace, arenaSize, FitPolicy::SegregatedFit, ZeroPolicy::None);
+    if (name == "freelist-indexed")
+        return ReplayArena<FreeListAllocator>(trace, arenaSize, FitPolicy::IndexedBestFit, ZeroPolicy::None);
+    if (name == "tlsf")
+        return ReplayArena<TLSFAllocator>(trace, arenaSize);
+    if (name == "buddy")
+        return ReplayArena<BuddyAllocator>(trace, arenaSize);
+    if (name == "new-delete")
+        return ReplayBaseline<NewDeleteBaseline>(trace);
+
+    return ReplayBaseline<PoolResourceBaseline<std::pmr::unsynchronized_pool_resource>>(trace);
+}
+
+
+static void PrintResult(const std::string& name, const ReplayTrace& trace, const ReplayResult& result)
+{
+    if (result.outOfMemory)
+    {
+        std::printf("%-20s out of memory at op %zu, try a larger --arena\n", name.c_str(), result.failedOp);
+        return;
+    }
+
+    std::printf("%-20s %10.0f  %5llu %6llu %7llu %8llu  %5llu %6llu %7llu %8llu", name.c_str(), result.opsPerSecond,
+        static_cast<unsigned long long>(result.allocateNs.p50), static_cast<unsigned long long>(result.allocateNs.p99),
+        static_cast<unsigned long long>(result.allocateNs.p999), static_cast<unsigned long long>(result.allocateNs.max),
+        static_cast<unsigned long long>(result.freeNs.p50), static_cast<unsigned long long>(result.freeNs.p99),
+        static_cast<unsigned long long>(result.freeNs.p999), static_cast<unsigned long long>(result.freeNs.max));
+
+    // Overhead: headers, padding and rounding at the peak. Fragmentation: the part of the address
+    // range the allocator touched that was never in use at once
+    if (result.peakUsed != 0 && trace.peakRequested != 0)
+    {
+        const double overhead = 100.0 * (static_cast<double>(result.peakUsed) / trace.peakRequested - 1.0);
+        const double fragmentation = result.touched > result.peakUsed
+            ? 100.0 * (1.0 - static_cast<double>(result.peakUsed) / result.touched) : 0.0;
+
+        std::printf("  %9zu  %7.1f%%  %6.1f%%\n", result.peakUsed / 1024u, overhead, fragmentation);
+    }
+    else
+        std::printf("  %9s  %8s  %7s\n", "-", "-", "-");
+}
+
+
+int main(int argc, char** argv)
+{
+    const char* path = nullptr;
+    std::size_t arenaMiB = 0;
+    std::vector<std::string> engines;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--arena") == 0 && i + 1 < argc)
+            arenaMiB = std::strtoull(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--engine") == 0 && i + 1 < argc)
+        {
+            engines.emplace_back(argv[++i]);
+
+            if (std::find(std::begin(kEngineNames), std::end(kEngineNames), engines.back()) == std::end(kEngineNames))
+            {
+                std::fprintf(stderr, "unknown engine %s\n%s", argv[i], kUsage);
+                return 1;
+            }
+        }
+        else if (path == nullptr && argv[i][0] != '-')
+            path = argv[i];
+        else
+        {
+            std::fputs(kUsage, stderr);
+            return 1;
+        }
+    }
+
+    if (path == nullptr)
+    {
+        std::fputs(kUsage, stderr);
+        return 1;
+    }
+
+    if (engines.empty())
+        engines.assign(std::begin(kEngineNames), std::end(kEngineNames));
+
+    ReplayTrace trace;
+    if (!ReadTrace(path, trace))
+        return 1;
+
+    // Four times the peak leaves room for headers and for the buddy rounding
+    const std::size_t minArena = std::size_t(1) << 20;
+    const std::size_t arenaSize = arenaMiB != 0 ? arenaMiB << 20 : std::max(minArena, trace.peakRequested * 4u);
+
+    std::printf("%zu records from %zu threads: %zu allocations, %zu frees replayed, %zu unmatched frees, %zu lost frees\n",
+        trace.numRecords, trace.numThreads, trace.objects.size(),
+        trace.ops.size() - trace.objects.size(), trace.unmatchedFrees, trace.lostFrees);
+    std::printf("peak requested %zu KiB, arena %zu KiB\n\n", trace.peakRequested / 1024u, arenaSize / 1024u);
+
+    std::printf("%-20s %10s  %-29s  %-29s  %9s  %8s  %7s\n", "", "", "allocate ns", "free ns", "", "", "");
+    std::printf("%-20s %10s  %5s %6s %7s %8s  %5s %6s %7s %8s  %9s  %8s  %7s\n", "engine", "ops/s",
+        "p50", "p99", "p99.9", "max", "p50", "p99", "p99.9", "max", "peak KiB", "overhead", "frag");
+
+    for (const std::string& name : engines)
+        PrintResult(name, trace, RunEngine(name, trace, arenaSize));
+
+    return 0;
+}